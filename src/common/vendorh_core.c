@@ -0,0 +1,1122 @@
+#include "tusb_option.h"
+
+#if (TUSB_OPT_HOST_ENABLED && (CFG_TUH_DENSHA || CFG_TUH_GUNCON2 || CFG_TUH_SBC))
+
+#include "host/usbh.h"
+#include "host/usbh_classdriver.h"
+#include "host/hcd.h"
+#include "vendorh_core.h"
+
+// driver options, core code no enabled option needs is left out
+#include "../densha/densha_host.h"
+#include "../guncon2/guncon2_host.h"
+#include "../sbc/sbc_host.h"
+
+#define VENDORH_AUTO_POLL (CFG_TUH_DENSHA_AUTO_POLL || CFG_TUH_GUNCON2_AUTO_POLL || CFG_TUH_SBC_AUTO_POLL)
+#define VENDORH_ON_CHANGE (CFG_TUH_DENSHA_REPORT_ON_CHANGE || CFG_TUH_GUNCON2_REPORT_ON_CHANGE || CFG_TUH_SBC_REPORT_ON_CHANGE)
+#define VENDORH_RING      (CFG_TUH_DENSHA_RING_SIZE || CFG_TUH_GUNCON2_RING_SIZE || CFG_TUH_SBC_RING_SIZE)
+#define VENDORH_STATS     (CFG_TUH_DENSHA_STATS || CFG_TUH_GUNCON2_STATS || CFG_TUH_SBC_STATS)
+#define VENDORH_RECOVERY  (CFG_TUH_DENSHA_RECOVERY || CFG_TUH_GUNCON2_RECOVERY || CFG_TUH_SBC_RECOVERY)
+#define VENDORH_AXIS_CAL  (CFG_TUH_DENSHA_AXIS_CAL || CFG_TUH_SBC_AXIS_CAL)
+
+void vendorh_seq_read(uint32_t const *seq, void *dst, void const *src, uint16_t len)
+{
+    uint32_t start;
+    do
+    {
+        start = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        memcpy(dst, src, len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((start & 1) || start != __atomic_load_n(seq, __ATOMIC_RELAXED));
+}
+
+void vendorh_axis_init(vendorh_axis_t *axis, vendorh_axis_cal_t const *cal)
+{
+    axis->cal = *cal;
+    vendorh_axis_build(axis);
+}
+
+void vendorh_axis_build(vendorh_axis_t *axis)
+{
+    vendorh_axis_cal_t const *cal = &axis->cal;
+    axis->dirty = false;
+
+    bool const bipolar = cal->flags & VENDORH_AXIS_BIPOLAR;
+    bool const invert = cal->flags & VENDORH_AXIS_INVERT;
+
+    // an inverted axis mirrors the raw input, so deadzone and curve still start at rest
+    int32_t const zero = bipolar ? cal->center : invert ? cal->max : cal->min;
+    int32_t const span_pos = invert ? zero - cal->min : cal->max - zero;
+    int32_t const span_neg = invert ? cal->max - zero : zero - cal->min;
+
+    for (int32_t raw = 0; raw < 256; raw++)
+    {
+        // distance from the rest position and the span on that side
+        int32_t dist = invert ? zero - raw : raw - zero;
+        int32_t span = dist >= 0 ? span_pos : span_neg;
+        bool const negative = dist < 0;
+
+        dist = negative ? -dist : dist;
+        dist -= cal->deadzone;
+        span -= cal->deadzone;
+
+        int32_t value = 0; // Q15
+        if (dist > 0 && span > 0 && dist >= span)
+        {
+            value = 32767; // exact, the blend below rounds it down
+        }
+        else if (dist > 0 && span > 0)
+        {
+            value = (dist * 32767 + span / 2) / span;
+
+            // blend towards value^3
+            int32_t const cube = (((value * value) >> 15) * value) >> 15;
+            value -= ((value - cube) * cal->curve) / 255;
+        }
+
+        if (negative)
+            value = bipolar ? -value : 0;
+
+        axis->lut[raw] = (int16_t)value;
+    }
+}
+
+void vendorh_axis_autocal(vendorh_axis_t *axis, bool enable)
+{
+    axis->autocal = enable;
+    if (!enable)
+        return;
+
+    // collapse the range, the next samples open it up again
+    axis->cal.min = 255;
+    axis->cal.max = 0;
+    axis->dirty = true;
+}
+
+uint32_t vendorh_frame_number(uint8_t dev_addr)
+{
+    return hcd_frame_number(usbh_get_rhport(dev_addr));
+}
+
+bool vendorh_open_endpoints(uint8_t dev_addr, tusb_desc_interface_t const *desc_itf, uint16_t max_len,
+                            vendorh_epmap_t *map, uint8_t instance,
+                            uint8_t *ep_in, uint16_t *epin_size, uint8_t *ep_out, uint16_t *epout_size)
+{
+    //Parse descriptor for all endpoints and open them
+    uint8_t const *p_desc = (uint8_t const *)desc_itf;
+    int endpoint = 0;
+    int pos = 0;
+    while (endpoint < desc_itf->bNumEndpoints && pos < max_len)
+    {
+        if (tu_desc_type(p_desc) != TUSB_DESC_ENDPOINT)
+        {
+            pos += tu_desc_len(p_desc);
+            p_desc = tu_desc_next(p_desc);
+            continue;
+        }
+        tusb_desc_endpoint_t const *desc_ep = (tusb_desc_endpoint_t const *)p_desc;
+        TU_ASSERT(TUSB_DESC_ENDPOINT == desc_ep->bDescriptorType);
+        TU_ASSERT(tuh_edpt_open(dev_addr, desc_ep));
+        map->ep2inst[tu_edpt_dir(desc_ep->bEndpointAddress)][tu_edpt_number(desc_ep->bEndpointAddress) & 0x0F] = instance + 1;
+        if (tu_edpt_dir(desc_ep->bEndpointAddress) == TUSB_DIR_OUT)
+        {
+            *ep_out = desc_ep->bEndpointAddress;
+            *epout_size = tu_edpt_packet_size(desc_ep);
+        }
+        else
+        {
+            *ep_in = desc_ep->bEndpointAddress;
+            *epin_size = tu_edpt_packet_size(desc_ep);
+        }
+        endpoint++;
+        pos += tu_desc_len(p_desc);
+        p_desc = tu_desc_next(p_desc);
+    }
+
+    return true;
+}
+
+bool vendorh_edpt_arm(uint8_t dev_addr, uint8_t ep_addr, uint8_t *buf, uint16_t len)
+{
+    TU_VERIFY(usbh_edpt_claim(dev_addr, ep_addr));
+
+    if ( !usbh_edpt_xfer(dev_addr, ep_addr, buf, len) )
+    {
+        usbh_edpt_release(dev_addr, ep_addr);
+        return false;
+    }
+    return true;
+}
+
+bool vendorh_control_xfer(uint8_t dev_addr, tusb_control_request_t const *request, uint8_t *buffer,
+                          tuh_xfer_cb_t complete_cb, uintptr_t user_data)
+{
+    tuh_xfer_t xfer = {
+        .daddr       = dev_addr,
+        .ep_addr     = 0, // control endpoint has address 0
+        .setup       = request,
+        .buffer      = buffer,
+        .complete_cb = complete_cb,
+        .user_data   = user_data
+    };
+
+    return tuh_control_xfer(&xfer);
+}
+
+bool vendorh_recovery_fail(vendorh_recovery_t *rec, uint8_t ep_addr, xfer_result_t result)
+{
+    rec->ep_addr = ep_addr;
+    rec->due = true;
+    rec->scheduled = false;
+    if (rec->failures < UINT8_MAX)
+        rec->failures++;
+
+    // FAILED and TIMEOUT are usually transient, a stall needs the halt cleared
+    if (result == XFER_RESULT_STALLED)
+        rec->stalled = true;
+
+    if (rec->link == VENDORH_LINK_DEGRADED)
+        return false;
+
+    rec->link = VENDORH_LINK_DEGRADED;
+    return true;
+}
+
+bool vendorh_recovery_ok(vendorh_recovery_t *rec)
+{
+    if (rec->link == VENDORH_LINK_UP)
+        return false;
+
+    rec->link = VENDORH_LINK_UP;
+    rec->failures = 0;
+    return true;
+}
+
+//--------------------------------------------------------------------+
+// Class drivers
+//--------------------------------------------------------------------+
+
+static vendorh_class_t const *_classes[VENDORH_CLASS_COUNT];
+
+TU_ATTR_ALWAYS_INLINE static inline uint8_t *get_epin_buf(vendorh_class_t const *cls, vendorh_itf_t *itf, uint8_t idx)
+{
+    return (uint8_t *)vendorh_itf_member(itf, cls->epin_offset) + idx * cls->epin_bufsize;
+}
+
+TU_ATTR_ALWAYS_INLINE static inline uint8_t *get_epout_buf(vendorh_class_t const *cls, vendorh_itf_t *itf)
+{
+    return (uint8_t *)vendorh_itf_member(itf, cls->epout_offset);
+}
+
+#if VENDORH_STATS
+// NULL if the driver keeps no statistics
+TU_ATTR_ALWAYS_INLINE static inline vendorh_stats_t *get_stats(vendorh_class_t const *cls, vendorh_itf_t *itf)
+{
+    return cls->stats_offset ? (vendorh_stats_t *)vendorh_itf_member(itf, cls->stats_offset) : NULL;
+}
+#endif
+
+static uint8_t _mount_gen;
+
+// Control transfer user_data: class, instance and the mount it was sent for
+TU_ATTR_ALWAYS_INLINE static inline uintptr_t ctrl_tag(vendorh_class_t const *cls, vendorh_itf_t const *itf, uint8_t instance)
+{
+    return (uintptr_t)cls->id | (uintptr_t)instance << 8 | (uintptr_t)itf->mount_gen << 16;
+}
+
+// Interface a control transfer was sent for, NULL if it was closed or
+// mounted again (possibly another device at the same address) meanwhile
+static vendorh_itf_t *ctrl_tag_itf(tuh_xfer_t const *xfer, vendorh_class_t const **cls, uint8_t *instance)
+{
+    *cls = _classes[xfer->user_data & 0xFF];
+    *instance = (uint8_t)(xfer->user_data >> 8);
+
+    vendorh_itf_t *itf = vendorh_get_itf(*cls, xfer->daddr, *instance);
+    if (!itf->connected || itf->mount_gen != (uint8_t)(xfer->user_data >> 16))
+        return NULL;
+    return itf;
+}
+
+static uint8_t get_instance_id_by_itfnum(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t itf_num)
+{
+    for (uint8_t inst = 0; inst < cls->itf_max; inst++)
+    {
+        vendorh_itf_t *itf = vendorh_get_itf(cls, dev_addr, inst);
+
+        if ((itf->itf_num == itf_num) && (itf->ep_in || itf->ep_out))
+            return inst;
+    }
+
+    return 0xff;
+}
+
+#if VENDORH_RECOVERY
+static void recovery_clear_halt_cb(tuh_xfer_t *xfer)
+{
+    vendorh_class_t const *cls;
+    uint8_t instance;
+    vendorh_itf_t *itf = ctrl_tag_itf(xfer, &cls, &instance);
+
+    // device was removed while the request was pending
+    if (!itf)
+        return;
+
+    vendorh_recovery_t *rec = (vendorh_recovery_t *)vendorh_itf_member(itf, cls->recovery_offset);
+    rec->clearing = false;
+
+    if (xfer->result == XFER_RESULT_SUCCESS)
+    {
+        // the device cleared its halt, reset the host side data toggle to match.
+        // The re-arm follows on the next task call
+        hcd_edpt_clear_stall(usbh_get_rhport(xfer->daddr), xfer->daddr, rec->ep_addr);
+        rec->stalled = false;
+    }
+    else
+    {
+        vendorh_recovery_fail(rec, rec->ep_addr, xfer->result);
+    }
+}
+
+// Clear a stalled endpoint and re-arm it once the backoff expired
+static void recovery_task(vendorh_class_t const *cls, vendorh_itf_t *itf, uint8_t dev_addr, uint8_t instance, uint32_t now_ms)
+{
+    vendorh_recovery_t *rec = (vendorh_recovery_t *)vendorh_itf_member(itf, cls->recovery_offset);
+
+    if (!rec->due || rec->clearing)
+        return;
+
+    if (!rec->scheduled)
+    {
+        uint8_t const shift = (uint8_t)TU_MIN(rec->failures - 1, 16);
+        uint32_t const backoff = TU_MIN((uint32_t)CFG_TUH_VENDORH_BACKOFF_MIN_MS << shift, CFG_TUH_VENDORH_BACKOFF_MAX_MS);
+
+        rec->retry_ms = now_ms + backoff;
+        rec->scheduled = true;
+        return;
+    }
+
+    if ((int32_t)(now_ms - rec->retry_ms) < 0)
+        return;
+
+    if (rec->stalled)
+    {
+        tusb_control_request_t const request = {
+            .bmRequestType_bit = {
+                .recipient = TUSB_REQ_RCPT_ENDPOINT,
+                .type      = TUSB_REQ_TYPE_STANDARD,
+                .direction = TUSB_DIR_OUT
+            },
+            .bRequest = TUSB_REQ_CLEAR_FEATURE,
+            .wValue   = tu_htole16(TUSB_REQ_FEATURE_EDPT_HALT),
+            .wIndex   = tu_htole16(rec->ep_addr),
+            .wLength  = 0
+        };
+        rec->request = request;
+
+        // EP0 busy, try again on the next call
+        if (vendorh_control_xfer(dev_addr, &rec->request, NULL, recovery_clear_halt_cb, ctrl_tag(cls, itf, instance)))
+            rec->clearing = true;
+        return;
+    }
+
+    rec->due = false;
+
+    // already armed by the application
+    if (usbh_edpt_busy(dev_addr, rec->ep_addr))
+        return;
+
+    if (!vendorh_receive_report(cls, dev_addr, instance))
+        vendorh_recovery_fail(rec, rec->ep_addr, XFER_RESULT_FAILED);
+}
+#endif
+
+#if VENDORH_RING
+static void ring_push(vendorh_class_t const *cls, vendorh_itf_t *itf)
+{
+    vendorh_ring_t *ring = (vendorh_ring_t *)vendorh_itf_member(itf, cls->ring_idx_offset);
+
+    uint32_t seq;
+    int32_t const slot = vendorh_ring_reserve(ring, cls->ring_depth, &seq);
+    if (slot < 0)
+        return;
+
+    uint8_t *entry = (uint8_t *)vendorh_itf_member(itf, cls->ring_offset) + (uint32_t)slot * cls->ring_entry_size;
+    uint32_t const head[3] = { itf->report_time.time_us, itf->report_time.frame, seq };
+    memcpy(entry, head, sizeof(head));
+    memcpy(entry + cls->ring_entry_pad, vendorh_itf_member(itf, cls->pad_offset), cls->pad_size);
+
+    vendorh_ring_publish(ring);
+}
+#endif
+
+// Diff a decoded report against the current pad and publish it if anything moved
+#if VENDORH_AXIS_CAL
+static void axes_decode(vendorh_class_t const *cls, vendorh_itf_t *itf, void const *pad, int16_t *axes)
+{
+    vendorh_axis_t *axis = (vendorh_axis_t *)vendorh_itf_member(itf, cls->axis_offset);
+    uint8_t const *raw = (uint8_t const *)pad;
+
+    for (uint8_t i = 0; i < cls->axis_count; i++)
+    {
+        axes[i] = vendorh_axis_get(&axis[i], raw[cls->axis_src[i]]);
+    }
+}
+
+// Apply calibration requests from the application and rebuild changed tables,
+// in the driver task so the transfer callback only ever looks a value up
+static void axes_task(vendorh_class_t const *cls, vendorh_itf_t *itf)
+{
+    vendorh_axis_t *axis = (vendorh_axis_t *)vendorh_itf_member(itf, cls->axis_offset);
+
+    for (uint8_t i = 0; i < cls->axis_count; i++)
+    {
+        uint8_t const req = __atomic_exchange_n(&axis[i].request, 0, __ATOMIC_ACQ_REL);
+        if (req)
+        {
+            vendorh_axis_cal_t cal;
+            if (req & VENDORH_AXIS_REQ_CAL)
+            {
+                vendorh_seq_read(&axis[i].request_seq, &cal, &axis[i].request_cal, sizeof(cal));
+            }
+
+            vendorh_seq_write_begin(&itf->pad_seq);
+            if (req & VENDORH_AXIS_REQ_CAL)
+            {
+                axis[i].cal = cal;
+                axis[i].dirty = true;
+            }
+            if (req & VENDORH_AXIS_REQ_AUTOCAL_OFF)
+            {
+                vendorh_axis_autocal(&axis[i], false);
+            }
+            if (req & VENDORH_AXIS_REQ_AUTOCAL_ON)
+            {
+                vendorh_axis_autocal(&axis[i], true);
+            }
+            vendorh_seq_write_end(&itf->pad_seq);
+        }
+
+        // only this task and the transfer callback use the table
+        if (axis[i].dirty)
+        {
+            vendorh_axis_build(&axis[i]);
+        }
+    }
+}
+#endif
+
+static void report_received(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf,
+                            uint8_t const *rdata, uint32_t len)
+{
+    // taken first so decoding time does not skew it
+    vendorh_report_time_t const report_time = { vendorh_time_us(cls), vendorh_frame_number(dev_addr) };
+
+#if VENDORH_RECOVERY
+    if (cls->recovery_offset && vendorh_recovery_ok((vendorh_recovery_t *)vendorh_itf_member(itf, cls->recovery_offset)) && cls->link)
+    {
+        cls->link(dev_addr, instance, VENDORH_LINK_UP);
+    }
+#endif
+
+    TU_LOG2("Get Report callback (%u, %u, %u bytes)\r\n", dev_addr, instance, len);
+    TU_LOG2_MEM(rdata, len, 2);
+
+    tu_memclr(vendorh_itf_member(itf, cls->delta_offset), cls->delta_size);
+    bool changed = false;
+
+    uint64_t pad[VENDORH_PAD_MAX / sizeof(uint64_t)];
+    if (cls->decode(itf, rdata, len, pad))
+    {
+        void *cur = vendorh_itf_member(itf, cls->pad_offset);
+        changed = cls->diff(cur, pad, vendorh_itf_member(itf, cls->delta_offset));
+
+        // one write section, a reader never pairs a pad with another report's time or axes
+        vendorh_seq_write_begin(&itf->pad_seq);
+        if (changed)
+        {
+            memcpy(cur, pad, cls->pad_size);
+        }
+        itf->report_time = report_time;
+#if VENDORH_AXIS_CAL
+        axes_decode(cls, itf, pad, (int16_t *)vendorh_itf_member(itf, cls->axes_offset)); // autocal updates cal
+#endif
+        if (cls->publish)
+        {
+            cls->publish(itf, pad);
+        }
+        vendorh_seq_write_end(&itf->pad_seq);
+        itf->new_pad_data = true;
+
+        if (cls->decoded)
+        {
+            cls->decoded(dev_addr, instance, itf);
+        }
+    }
+
+#if VENDORH_STATS
+    vendorh_stats_t *stats = get_stats(cls, itf);
+    if (stats)
+    {
+        if (itf->new_pad_data)
+            vendorh_stats_report(stats, report_time.time_us);
+        else
+            stats->rejected++;
+    }
+#endif
+
+#if VENDORH_RING
+    if (cls->ring_depth && itf->new_pad_data)
+    {
+        ring_push(cls, itf);
+    }
+#endif
+
+#if VENDORH_ON_CHANGE
+    if (changed || !(cls->flags & VENDORH_CLASS_REPORT_ON_CHANGE))
+#endif
+    {
+        cls->notify(dev_addr, instance, itf, rdata, (uint16_t)len);
+    }
+    itf->new_pad_data = false;
+    (void)changed;
+
+    // retry outputs that found the pipe busy
+    if (cls->flush)
+    {
+        cls->flush(dev_addr, instance, itf);
+    }
+
+#if VENDORH_STATS
+    if (stats)
+    {
+        vendorh_stats_hist(stats->callback_us, vendorh_time_us(cls) - report_time.time_us);
+    }
+#endif
+}
+
+void vendorh_init(vendorh_class_t const *cls)
+{
+    tu_memclr(cls->devs, (size_t)cls->dev_size * CFG_TUH_DEVICE_MAX);
+    _classes[cls->id] = cls;
+}
+
+bool vendorh_open(vendorh_class_t const *cls, uint8_t dev_addr, tusb_desc_interface_t const *desc_itf, uint16_t max_len)
+{
+    TU_VERIFY(dev_addr <= CFG_TUH_DEVICE_MAX);
+
+    uint16_t PID, VID;
+    tuh_vid_pid_get(dev_addr, &VID, &PID);
+
+    uint8_t const variant = cls->match(VID, PID, desc_itf);
+    if (variant == VENDORH_NO_MATCH)
+    {
+        TU_LOG2("%s: not a known device\n", cls->name);
+        return false;
+    }
+
+    TU_LOG2("%s opening Interface %u (addr = %u)\r\n", cls->name, desc_itf->bInterfaceNumber, dev_addr);
+
+    vendorh_dev_t *dev = vendorh_get_dev(cls, dev_addr);
+    TU_ASSERT(dev->inst_count < cls->itf_max, 0);
+
+    vendorh_itf_t *itf = vendorh_get_itf(cls, dev_addr, dev->inst_count);
+    itf->itf_num = desc_itf->bInterfaceNumber;
+    itf->variant = variant;
+
+    TU_ASSERT(vendorh_open_endpoints(dev_addr, desc_itf, max_len, &dev->epmap, dev->inst_count,
+                                     &itf->ep_in, &itf->epin_size, &itf->ep_out, &itf->epout_size));
+
+    dev->inst_count++;
+    return true;
+}
+
+bool vendorh_set_config(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t itf_num)
+{
+    uint8_t const instance = get_instance_id_by_itfnum(cls, dev_addr, itf_num);
+    TU_VERIFY(instance < cls->itf_max);
+
+    vendorh_itf_t *itf = vendorh_get_itf(cls, dev_addr, instance);
+    itf->connected = true;
+    itf->mount_gen = ++_mount_gen;
+
+#if VENDORH_AXIS_CAL
+    vendorh_axis_t *axis = (vendorh_axis_t *)vendorh_itf_member(itf, cls->axis_offset);
+    for (uint8_t i = 0; cls->axis_default && i < cls->axis_count; i++)
+    {
+        vendorh_axis_init(&axis[i], &cls->axis_default[i]);
+    }
+#endif
+
+    if (cls->mount)
+    {
+        cls->mount(dev_addr, instance, itf);
+    }
+
+    usbh_driver_set_config_complete(dev_addr, itf->itf_num);
+    return true;
+}
+
+// Completed transfer with its data, from the endpoint or a replayed trace
+static bool xfer_done(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf,
+                      uint8_t ep_addr, xfer_result_t result, uint8_t const *buf, uint32_t xferred_bytes)
+{
+    uint8_t const dir = tu_edpt_dir(ep_addr);
+
+    if (result != XFER_RESULT_SUCCESS)
+    {
+        TU_LOG1("%s: transfer error %d\n", cls->name, result);
+#if VENDORH_STATS
+        if (cls->stats_offset)
+        {
+            vendorh_stats_error(get_stats(cls, itf), result);
+        }
+#endif
+#if VENDORH_RECOVERY
+        // re-armed from the driver task after a backoff
+        if (dir == TUSB_DIR_IN && cls->recovery_offset &&
+            vendorh_recovery_fail((vendorh_recovery_t *)vendorh_itf_member(itf, cls->recovery_offset), ep_addr, result) && cls->link)
+        {
+            cls->link(dev_addr, instance, VENDORH_LINK_DEGRADED);
+        }
+#endif
+        if (dir == TUSB_DIR_OUT && cls->out_done)
+        {
+            cls->out_done(dev_addr, instance, itf, result, buf, (uint16_t)xferred_bytes);
+        }
+        return false;
+    }
+
+    if (dir == TUSB_DIR_IN)
+    {
+        report_received(cls, dev_addr, instance, itf, buf, xferred_bytes);
+    }
+    else
+    {
+        if (cls->out_done)
+        {
+            cls->out_done(dev_addr, instance, itf, result, buf, (uint16_t)xferred_bytes);
+        }
+
+        // send outputs that came in while the endpoint was busy
+        if (cls->build_out)
+        {
+            vendorh_out_flush(cls, dev_addr, instance);
+        }
+    }
+
+    return true;
+}
+
+#if VENDORH_AUTO_POLL
+// Nothing is in flight anymore: tell the application, which can start again
+static void poll_stop(vendorh_class_t const *cls, vendorh_itf_t *itf)
+{
+    itf->polling = false;
+#if VENDORH_STATS
+    if (cls->stats_offset)
+    {
+        get_stats(cls, itf)->poll_stopped++;
+    }
+#else
+    (void)cls;
+#endif
+}
+#endif
+
+bool vendorh_xfer_cb(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+    TU_VERIFY(dev_addr && dev_addr <= CFG_TUH_DEVICE_MAX);
+    uint8_t const instance = vendorh_epmap_get(&vendorh_get_dev(cls, dev_addr)->epmap, ep_addr);
+    TU_VERIFY(instance < cls->itf_max);
+
+    vendorh_itf_t *itf = vendorh_get_itf(cls, dev_addr, instance);
+    uint8_t const *buf = tu_edpt_dir(ep_addr) == TUSB_DIR_IN ? get_epin_buf(cls, itf, itf->epin_idx) : get_epout_buf(cls, itf);
+
+#if CFG_TUH_VENDORH_TRACE
+    vendorh_trace_capture(vendorh_time_us(cls), dev_addr, instance, ep_addr, result, buf, xferred_bytes);
+#endif
+
+    if (tu_edpt_dir(ep_addr) == TUSB_DIR_IN && result == XFER_RESULT_SUCCESS)
+    {
+        itf->epin_idx ^= 1;
+
+#if VENDORH_AUTO_POLL
+        // queue the next transfer into the other buffer before decoding this one
+        if (itf->polling && !vendorh_receive_report(cls, dev_addr, instance))
+        {
+            poll_stop(cls, itf);
+        }
+#endif
+    }
+#if VENDORH_AUTO_POLL
+    else if (tu_edpt_dir(ep_addr) == TUSB_DIR_IN && itf->polling && !cls->recovery_offset)
+    {
+        // nothing re-arms the endpoint without recovery
+        poll_stop(cls, itf);
+    }
+#endif
+
+    return xfer_done(cls, dev_addr, instance, itf, ep_addr, result, buf, xferred_bytes);
+}
+
+void vendorh_close(vendorh_class_t const *cls, uint8_t dev_addr)
+{
+    TU_VERIFY(dev_addr <= CFG_TUH_DEVICE_MAX, );
+    vendorh_dev_t *dev = vendorh_get_dev(cls, dev_addr);
+
+    for (uint8_t inst = 0; inst < dev->inst_count; inst++)
+    {
+        if (cls->umount)
+        {
+            cls->umount(dev_addr, inst);
+        }
+    }
+    tu_memclr(dev, cls->dev_size);
+}
+
+bool vendorh_receive_report(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    TU_VERIFY(itf);
+
+    return vendorh_edpt_arm(dev_addr, itf->ep_in, get_epin_buf(cls, itf, itf->epin_idx), itf->epin_size);
+}
+
+bool vendorh_get_pad(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, void *pad)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    TU_VERIFY(itf);
+
+    vendorh_seq_read(&itf->pad_seq, pad, vendorh_itf_member(itf, cls->pad_offset), cls->pad_size);
+
+    return true;
+}
+
+bool vendorh_get_report_time(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, vendorh_report_time_t *report_time)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    TU_VERIFY(itf);
+
+    vendorh_seq_read(&itf->pad_seq, report_time, &itf->report_time, sizeof(vendorh_report_time_t));
+
+    return true;
+}
+
+#if VENDORH_AUTO_POLL
+bool vendorh_start_polling(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    TU_VERIFY(itf);
+
+    itf->polling = true;
+
+    // an IN transfer may already be queued by the application
+    if (usbh_edpt_busy(dev_addr, itf->ep_in))
+        return true;
+
+    return vendorh_receive_report(cls, dev_addr, instance);
+}
+
+void vendorh_stop_polling(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    TU_VERIFY(itf, );
+
+    // the pending transfer still completes, it is just not queued again
+    itf->polling = false;
+}
+
+bool vendorh_is_polling(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    return itf && itf->polling;
+}
+#endif
+
+#if VENDORH_RING
+bool vendorh_ring_pop(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, void *entry)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    TU_VERIFY(itf);
+
+    vendorh_ring_t *ring = (vendorh_ring_t *)vendorh_itf_member(itf, cls->ring_idx_offset);
+
+    int32_t const slot = vendorh_ring_peek(ring, cls->ring_depth);
+    if (slot < 0)
+        return false;
+
+    memcpy(entry, (uint8_t *)vendorh_itf_member(itf, cls->ring_offset) + (uint32_t)slot * cls->ring_entry_size, cls->ring_entry_size);
+    vendorh_ring_consume(ring);
+    return true;
+}
+#endif
+
+#if VENDORH_STATS
+bool vendorh_get_stats(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, vendorh_stats_t *stats)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    TU_VERIFY(itf);
+
+    *stats = *get_stats(cls, itf);
+    return true;
+}
+
+void vendorh_reset_stats(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    TU_VERIFY(itf, );
+
+    tu_memclr(get_stats(cls, itf), sizeof(vendorh_stats_t));
+}
+#endif
+
+#if VENDORH_AXIS_CAL
+bool vendorh_get_axes(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, int16_t *axes)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    TU_VERIFY(itf);
+
+    vendorh_seq_read(&itf->pad_seq, axes, vendorh_itf_member(itf, cls->axes_offset), cls->axis_count * sizeof(int16_t));
+
+    return true;
+}
+
+// Hand a request to the driver task, which owns cal and the table
+static bool axis_request(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, uint8_t axis,
+                         uint8_t req, vendorh_axis_cal_t const *cal)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    TU_VERIFY(itf && axis < cls->axis_count);
+
+    vendorh_axis_t *ax = (vendorh_axis_t *)vendorh_itf_member(itf, cls->axis_offset) + axis;
+    if (cal)
+    {
+        vendorh_seq_write_begin(&ax->request_seq);
+        ax->request_cal = *cal;
+        vendorh_seq_write_end(&ax->request_seq);
+    }
+    __atomic_or_fetch(&ax->request, req, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool vendorh_set_axis_cal(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, uint8_t axis, vendorh_axis_cal_t const *cal)
+{
+    return axis_request(cls, dev_addr, instance, axis, VENDORH_AXIS_REQ_CAL, cal);
+}
+
+bool vendorh_get_axis_cal(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, uint8_t axis, vendorh_axis_cal_t *cal)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    TU_VERIFY(itf && axis < cls->axis_count);
+
+    vendorh_axis_t const *ax = (vendorh_axis_t const *)vendorh_itf_member(itf, cls->axis_offset) + axis;
+    vendorh_seq_read(&itf->pad_seq, cal, &ax->cal, sizeof(*cal));
+
+    return true;
+}
+
+bool vendorh_set_autocal(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, uint8_t axis, bool enable)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    TU_VERIFY(itf && axis < cls->axis_count);
+
+    // the later call wins when both are pending
+    vendorh_axis_t *ax = (vendorh_axis_t *)vendorh_itf_member(itf, cls->axis_offset) + axis;
+    __atomic_and_fetch(&ax->request, (uint8_t)~(enable ? VENDORH_AXIS_REQ_AUTOCAL_OFF : VENDORH_AXIS_REQ_AUTOCAL_ON), __ATOMIC_RELAXED);
+    return axis_request(cls, dev_addr, instance, axis, enable ? VENDORH_AXIS_REQ_AUTOCAL_ON : VENDORH_AXIS_REQ_AUTOCAL_OFF, NULL);
+}
+#endif
+
+void vendorh_task(vendorh_class_t const *cls, uint32_t now_ms)
+{
+    for (uint8_t dev_addr = 1; dev_addr <= CFG_TUH_DEVICE_MAX; dev_addr++)
+    {
+        vendorh_dev_t *dev = vendorh_get_dev(cls, dev_addr);
+
+        for (uint8_t inst = 0; inst < dev->inst_count; inst++)
+        {
+            vendorh_itf_t *itf = vendorh_get_itf(cls, dev_addr, inst);
+            if (!itf->connected)
+                continue;
+
+            // outputs that failed or found the pipe busy while nothing else completes
+            if (cls->build_out)
+            {
+                vendorh_out_flush(cls, dev_addr, inst);
+            }
+            if (cls->flush)
+            {
+                cls->flush(dev_addr, inst, itf);
+            }
+            if (cls->tick)
+            {
+                cls->tick(dev_addr, inst, itf, now_ms);
+            }
+#if VENDORH_AXIS_CAL
+            if (cls->axis_count)
+            {
+                axes_task(cls, itf);
+            }
+#endif
+#if VENDORH_RECOVERY
+            if (cls->recovery_offset)
+            {
+                recovery_task(cls, itf, dev_addr, inst, now_ms);
+            }
+#endif
+        }
+    }
+}
+
+bool vendorh_out_flush(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance)
+{
+    vendorh_itf_t *itf = vendorh_get_itf(cls, dev_addr, instance);
+
+    // busy, sent from vendorh_xfer_cb when the endpoint completes
+    if (!usbh_edpt_claim(dev_addr, itf->ep_out))
+        return true;
+
+    uint8_t *buf = get_epout_buf(cls, itf);
+    uint16_t const len = cls->build_out(itf, buf);
+
+    if (!len)
+    {
+        usbh_edpt_release(dev_addr, itf->ep_out);
+        return true;
+    }
+
+    if (!usbh_edpt_xfer(dev_addr, itf->ep_out, buf, len))
+    {
+        usbh_edpt_release(dev_addr, itf->ep_out);
+        if (cls->out_done)
+        {
+            cls->out_done(dev_addr, instance, itf, XFER_RESULT_FAILED, buf, len);
+        }
+        return false;
+    }
+
+#if VENDORH_STATS
+    if (cls->stats_offset)
+    {
+        get_stats(cls, itf)->out_sent++;
+    }
+#endif
+    return true;
+}
+
+static void ctrl_complete_cb(tuh_xfer_t *xfer)
+{
+    uint8_t const dev_addr = xfer->daddr;
+    vendorh_class_t const *cls;
+    uint8_t instance;
+    vendorh_itf_t *itf = ctrl_tag_itf(xfer, &cls, &instance);
+
+    // device was removed while the request was pending
+    if (!itf)
+        return;
+
+    if (xfer->result != XFER_RESULT_SUCCESS)
+    {
+        TU_LOG1("%s: control request %u failed: %d\n", cls->name, itf->ctrl_request.bRequest, xfer->result);
+#if VENDORH_STATS
+        if (cls->stats_offset)
+        {
+            vendorh_stats_error(get_stats(cls, itf), xfer->result);
+        }
+#endif
+
+        // EP0 is idle again here, send the same request while retries are left
+        if (itf->ctrl_retries &&
+            vendorh_control_xfer(dev_addr, &itf->ctrl_request, xfer->buffer, ctrl_complete_cb, xfer->user_data))
+        {
+            itf->ctrl_retries--;
+#if VENDORH_STATS
+            if (cls->stats_offset)
+            {
+                get_stats(cls, itf)->out_sent++;
+            }
+#endif
+            return;
+        }
+    }
+
+    itf->ctrl_inflight = false;
+
+    if (cls->ctrl_done)
+    {
+        cls->ctrl_done(dev_addr, instance, itf, xfer->result, xfer->buffer, itf->ctrl_request.wLength);
+    }
+
+    if (cls->flush)
+    {
+        cls->flush(dev_addr, instance, itf);
+    }
+}
+
+bool vendorh_ctrl_send(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance,
+                       tusb_control_request_t const *request, uint8_t *buffer)
+{
+    vendorh_itf_t *itf = vendorh_get_itf(cls, dev_addr, instance);
+    TU_VERIFY(!itf->ctrl_inflight);
+
+    itf->ctrl_request = *request;
+    TU_VERIFY(vendorh_control_xfer(dev_addr, &itf->ctrl_request, buffer, ctrl_complete_cb,
+                                   ctrl_tag(cls, itf, instance)));
+
+    itf->ctrl_inflight = true;
+    itf->ctrl_retries = CFG_TUH_VENDORH_CTRL_RETRIES;
+#if VENDORH_STATS
+    if (cls->stats_offset)
+    {
+        get_stats(cls, itf)->out_sent++;
+    }
+#endif
+    return true;
+}
+
+#if CFG_TUH_VENDORH_TRACE
+
+static vendorh_trace_sink_t _trace_sink;
+static void *_trace_ctx;
+
+void vendorh_trace_set_sink(vendorh_trace_sink_t sink, void *ctx)
+{
+    _trace_ctx = ctx;
+    _trace_sink = sink;
+}
+
+void vendorh_trace_capture(uint32_t timestamp_us, uint8_t dev_addr, uint8_t instance, uint8_t ep_addr,
+                           xfer_result_t result, uint8_t const *data, uint32_t len)
+{
+    if (!_trace_sink)
+        return;
+
+    vendorh_trace_record_t const record = {
+        .timestamp_us = timestamp_us,
+        .dev_addr     = dev_addr,
+        .instance     = instance,
+        .ep_addr      = ep_addr,
+        .result       = (uint8_t)result,
+        .len          = (uint16_t)len
+    };
+
+    _trace_sink(&record, data, _trace_ctx);
+}
+
+void vendorh_trace_ring_init(vendorh_trace_ring_t *ring, uint8_t *buf, uint32_t size)
+{
+    tu_memclr(ring, sizeof(vendorh_trace_ring_t));
+    ring->buf = buf;
+    ring->size = size;
+}
+
+static void trace_ring_write(vendorh_trace_ring_t *ring, uint32_t pos, void const *src, uint32_t len)
+{
+    uint32_t const offset = pos & (ring->size - 1);
+    uint32_t const first = TU_MIN(len, ring->size - offset);
+
+    memcpy(ring->buf + offset, src, first);
+    memcpy(ring->buf, (uint8_t const *)src + first, len - first);
+}
+
+static void trace_ring_read(vendorh_trace_ring_t const *ring, uint32_t pos, void *dst, uint32_t len)
+{
+    uint32_t const offset = pos & (ring->size - 1);
+    uint32_t const first = TU_MIN(len, ring->size - offset);
+
+    memcpy(dst, ring->buf + offset, first);
+    memcpy((uint8_t *)dst + first, ring->buf, len - first);
+}
+
+void vendorh_trace_ring_sink(vendorh_trace_record_t const *record, uint8_t const *data, void *ctx)
+{
+    vendorh_trace_ring_t *ring = (vendorh_trace_ring_t *)ctx;
+    uint32_t const head = ring->head;
+    uint32_t const tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t const len = sizeof(vendorh_trace_record_t) + record->len;
+
+    if (ring->size - (head - tail) < len)
+    {
+        ring->dropped++;
+        return;
+    }
+
+    trace_ring_write(ring, head, record, sizeof(vendorh_trace_record_t));
+    trace_ring_write(ring, head + sizeof(vendorh_trace_record_t), data, record->len);
+
+    __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+}
+
+uint32_t vendorh_trace_ring_drain(vendorh_trace_ring_t *ring, uint8_t *dst, uint32_t max_len)
+{
+    uint32_t const head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = ring->tail;
+    uint32_t count = 0;
+
+    while (tail != head)
+    {
+        vendorh_trace_record_t record;
+        trace_ring_read(ring, tail, &record, sizeof(record));
+
+        uint32_t const len = sizeof(record) + record.len;
+        if (count + len > max_len)
+            break;
+
+        trace_ring_read(ring, tail, dst + count, len);
+        count += len;
+        tail += len;
+    }
+
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    return count;
+}
+
+uint32_t vendorh_trace_replay(uint8_t const *trace, uint32_t size, vendorh_trace_inject_t inject, void (*wait_us)(uint32_t us))
+{
+    uint32_t pos = 0;
+    uint32_t records = 0;
+    uint32_t prev_us = 0;
+
+    while (size - pos >= sizeof(vendorh_trace_record_t))
+    {
+        vendorh_trace_record_t record;
+        memcpy(&record, trace + pos, sizeof(record));
+        pos += sizeof(record);
+
+        // truncated trace
+        if (size - pos < record.len)
+            break;
+
+        if (wait_us && records)
+            wait_us(record.timestamp_us - prev_us);
+        prev_us = record.timestamp_us;
+
+        inject(record.dev_addr, record.instance, record.ep_addr, (xfer_result_t)record.result, trace + pos, record.len);
+        pos += record.len;
+        records++;
+    }
+
+    return records;
+}
+
+bool vendorh_replay(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, uint8_t ep_addr,
+                    xfer_result_t result, uint8_t const *data, uint16_t len)
+{
+    vendorh_itf_t *itf = vendorh_find_itf(cls, dev_addr, instance);
+    TU_VERIFY(itf);
+
+    // the endpoints of the mounted device are used, their numbers may differ from the trace.
+    // data is decoded in place, the endpoint buffers may be in use by a queued transfer.
+    uint8_t const ep = tu_edpt_dir(ep_addr) == TUSB_DIR_IN ? itf->ep_in : itf->ep_out;
+    TU_VERIFY(ep);
+
+    // an OUT completion would finish the frame really being sent
+    TU_VERIFY(tu_edpt_dir(ep) == TUSB_DIR_IN || !usbh_edpt_busy(dev_addr, ep));
+
+    return xfer_done(cls, dev_addr, instance, itf, ep, result, data, len);
+}
+
+#endif
+
+#endif
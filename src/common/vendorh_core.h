@@ -0,0 +1,605 @@
+// Shared host driver core for the custom tinyusb drivers by sonik-br
+// https://github.com/sonik-br
+//
+// Holds the parts that are the same for every driver: device and instance
+// storage, mounting, the transfer callback, polling, publishing decoded pads
+// to other cores, statistics, recovery and replay.
+// Drivers describe themselves with a vendorh_class_t and only keep their own
+// matching, decoding and output code as hooks.
+
+#ifndef _TUSB_VENDORH_CORE_H_
+#define _TUSB_VENDORH_CORE_H_
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+//--------------------------------------------------------------------+
+// Endpoint to instance map
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+    uint8_t ep2inst[2][16]; // [dir][ep number] -> instance + 1, 0 if not ours
+} vendorh_epmap_t;
+
+// 0xff if the endpoint was not opened through this map
+TU_ATTR_ALWAYS_INLINE static inline uint8_t vendorh_epmap_get(vendorh_epmap_t const *map, uint8_t ep_addr)
+{
+    return (uint8_t)(map->ep2inst[tu_edpt_dir(ep_addr)][tu_edpt_number(ep_addr) & 0x0F] - 1);
+}
+
+//--------------------------------------------------------------------+
+// Sequence lock
+//--------------------------------------------------------------------+
+
+// Data is published with a sequence lock: readers retry while the
+// sequence is odd or changed during their copy, the writer never waits.
+TU_ATTR_ALWAYS_INLINE static inline void vendorh_seq_write_begin(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+TU_ATTR_ALWAYS_INLINE static inline void vendorh_seq_write_end(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+void vendorh_seq_read(uint32_t const *seq, void *dst, void const *src, uint16_t len);
+
+//--------------------------------------------------------------------+
+// Single producer / single consumer ring indexes
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+    uint32_t head; // written by the producer only
+    uint32_t tail; // written by the consumer only
+    uint32_t seq;  // sequence number of the next pushed entry
+} vendorh_ring_t;
+
+// Slot for the next entry and its sequence number, -1 when full.
+// The sequence number is consumed either way so the reader sees the gap.
+TU_ATTR_ALWAYS_INLINE static inline int32_t vendorh_ring_reserve(vendorh_ring_t *ring, uint32_t depth, uint32_t *seq)
+{
+    uint32_t const head = ring->head;
+    uint32_t const tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    *seq = ring->seq++;
+    if (head - tail >= depth)
+        return -1;
+
+    return (int32_t)(head & (depth - 1));
+}
+
+TU_ATTR_ALWAYS_INLINE static inline void vendorh_ring_publish(vendorh_ring_t *ring)
+{
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+// Slot of the oldest entry, -1 when empty
+TU_ATTR_ALWAYS_INLINE static inline int32_t vendorh_ring_peek(vendorh_ring_t *ring, uint32_t depth)
+{
+    uint32_t const tail = ring->tail;
+    uint32_t const head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    if (head == tail)
+        return -1;
+
+    return (int32_t)(tail & (depth - 1));
+}
+
+TU_ATTR_ALWAYS_INLINE static inline void vendorh_ring_consume(vendorh_ring_t *ring)
+{
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+//--------------------------------------------------------------------+
+// Table driven report decoding
+//--------------------------------------------------------------------+
+
+// One report field: dst |= (((invert ? ~report[src] : report[src]) >> shift) & mask) << dst_shift
+typedef struct
+{
+    uint8_t src;       // report byte
+    uint8_t invert;    // active low bits
+    uint8_t shift;     // right shift of the report byte
+    uint8_t mask;      // bits kept after the shift
+    uint8_t dst;       // offset of the pad member
+    uint8_t dst_shift; // left shift into the pad member
+    uint8_t size;      // size of the pad member: 1, 2, 4 or 8
+} vendorh_field_t;
+
+#define VENDORH_FIELD(_src, _invert, _shift, _mask, _type, _member, _dst_shift) \
+    { _src, _invert, _shift, _mask, offsetof(_type, _member), _dst_shift, sizeof(((_type *)0)->_member) }
+
+// Decode every field of the table into the pad. Fields of one member must be
+// adjacent, the first one sets it and the others are or-ed in. Members the
+// table does not cover are left for the decoder to set. Inlined so a const
+// table is folded into straight-line code.
+TU_ATTR_ALWAYS_INLINE static inline void vendorh_decode_fields(vendorh_field_t const *fields, uint8_t count, uint8_t const *report, void *pad)
+{
+    uint8_t *const dst = (uint8_t *)pad;
+
+#if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC unroll 32
+#endif
+    for (vendorh_field_t const *f = fields; f < fields + count; f++)
+    {
+        uint8_t const raw = f->invert ? (uint8_t)~report[f->src] : report[f->src];
+        uint64_t value = (uint64_t)((raw >> f->shift) & f->mask) << f->dst_shift;
+        bool const first = f == fields || f[-1].dst != f->dst;
+
+        // memcpy keeps it alignment and endian safe, it compiles to plain loads and stores
+        switch (f->size)
+        {
+            case 1:
+                dst[f->dst] = (uint8_t)(first ? value : (dst[f->dst] | value));
+                break;
+            case 2:
+            {
+                uint16_t v = 0;
+                if (!first)
+                    memcpy(&v, dst + f->dst, 2);
+                v |= (uint16_t)value;
+                memcpy(dst + f->dst, &v, 2);
+                break;
+            }
+            case 4:
+            {
+                uint32_t v = 0;
+                if (!first)
+                    memcpy(&v, dst + f->dst, 4);
+                v |= (uint32_t)value;
+                memcpy(dst + f->dst, &v, 4);
+                break;
+            }
+            default:
+            {
+                uint64_t v = 0;
+                if (!first)
+                    memcpy(&v, dst + f->dst, 8);
+                v |= value;
+                memcpy(dst + f->dst, &v, 8);
+                break;
+            }
+        }
+    }
+}
+
+//--------------------------------------------------------------------+
+// Analog axis calibration
+//--------------------------------------------------------------------+
+
+#define VENDORH_AXIS_BIPOLAR 0x01 // -32767 at min, 0 at center, 32767 at max. Else 0 at min, 32767 at max
+#define VENDORH_AXIS_INVERT  0x02 // rest at max for unipolar axes, 32767 at min
+
+typedef struct
+{
+    uint8_t min;
+    uint8_t center;   // bipolar axes only
+    uint8_t max;
+    uint8_t deadzone; // raw units around center, or from the rest end for unipolar axes
+    uint8_t curve;    // 0 linear up to 255 cubic, for finer control near the rest position
+    uint8_t flags;    // VENDORH_AXIS_*
+} vendorh_axis_cal_t;
+
+#define VENDORH_AXIS_REQ_CAL         0x01
+#define VENDORH_AXIS_REQ_AUTOCAL_ON  0x02
+#define VENDORH_AXIS_REQ_AUTOCAL_OFF 0x04
+
+typedef struct
+{
+    vendorh_axis_cal_t cal;      // guarded by pad_seq
+    uint8_t autocal;             // widen min/max to the observed extremes
+    uint8_t dirty;               // cal changed, lut is rebuilt from the driver task
+    uint8_t request;             // VENDORH_AXIS_REQ_*, set by the application
+    vendorh_axis_cal_t request_cal; // guarded by request_seq
+    uint32_t request_seq;
+    int16_t lut[256];            // raw value -> normalized output
+} vendorh_axis_t;
+
+// Set the calibration and rebuild the lookup table
+void vendorh_axis_init(vendorh_axis_t *axis, vendorh_axis_cal_t const *cal);
+
+// Rebuild the lookup table from the current calibration
+void vendorh_axis_build(vendorh_axis_t *axis);
+
+// Start learning min/max from the next samples
+void vendorh_axis_autocal(vendorh_axis_t *axis, bool enable);
+
+// Normalize a raw sample. With autocal on, a sample outside the range widens
+// it and marks the table dirty, the sample saturates until the task rebuilds it
+TU_ATTR_ALWAYS_INLINE static inline int16_t vendorh_axis_get(vendorh_axis_t *axis, uint8_t raw)
+{
+    if (axis->autocal && (raw < axis->cal.min || raw > axis->cal.max))
+    {
+        axis->cal.min = TU_MIN(axis->cal.min, raw);
+        axis->cal.max = TU_MAX(axis->cal.max, raw);
+        axis->dirty = true;
+    }
+    return axis->lut[raw];
+}
+
+//--------------------------------------------------------------------+
+// Report timing
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+    uint32_t time_us; // from the driver's tuh_*_time_us_cb, 0 if not implemented
+    uint32_t frame;   // host SOF frame number (1 ms full speed)
+} vendorh_report_time_t;
+
+// Current SOF frame number of the root port the device is on
+uint32_t vendorh_frame_number(uint8_t dev_addr);
+
+//--------------------------------------------------------------------+
+// Statistics
+//--------------------------------------------------------------------+
+
+// Histogram bin n counts values in [2^n, 2^(n+1)) us, the last bin also
+// counts everything above (about 0.5 s and more)
+#define VENDORH_STATS_HIST_BINS 20
+
+typedef struct
+{
+    uint32_t reports;        // decoded reports
+    uint32_t rejected;       // IN reports that failed validation
+    uint32_t errors[XFER_RESULT_INVALID + 1]; // failed transfers by xfer_result_t
+    uint32_t out_sent;       // output transfers started
+    uint32_t out_coalesced;  // output updates replaced by a newer one or dropped as unchanged, each counted once
+    uint32_t poll_stopped;   // auto polling ended by a failed re-arm or an IN error without recovery
+    uint32_t interarrival_us[VENDORH_STATS_HIST_BINS]; // time between decoded reports
+    uint32_t callback_us[VENDORH_STATS_HIST_BINS];     // time spent handling an IN report
+    uint32_t last_report_us;
+} vendorh_stats_t;
+
+TU_ATTR_ALWAYS_INLINE static inline void vendorh_stats_hist(uint32_t *hist, uint32_t us)
+{
+    uint8_t bin = us ? (uint8_t)(31 - __builtin_clz(us)) : 0;
+    if (bin >= VENDORH_STATS_HIST_BINS)
+        bin = VENDORH_STATS_HIST_BINS - 1;
+    hist[bin]++;
+}
+
+TU_ATTR_ALWAYS_INLINE static inline void vendorh_stats_report(vendorh_stats_t *stats, uint32_t time_us)
+{
+    if (stats->reports++)
+        vendorh_stats_hist(stats->interarrival_us, time_us - stats->last_report_us);
+    stats->last_report_us = time_us;
+}
+
+TU_ATTR_ALWAYS_INLINE static inline void vendorh_stats_error(vendorh_stats_t *stats, xfer_result_t result)
+{
+    if (result <= XFER_RESULT_INVALID)
+        stats->errors[result]++;
+}
+
+//--------------------------------------------------------------------+
+// Endpoints
+//--------------------------------------------------------------------+
+
+// Open every endpoint of the interface, store them in map for instance
+bool vendorh_open_endpoints(uint8_t dev_addr, tusb_desc_interface_t const *desc_itf, uint16_t max_len,
+                            vendorh_epmap_t *map, uint8_t instance,
+                            uint8_t *ep_in, uint16_t *epin_size, uint8_t *ep_out, uint16_t *epout_size);
+
+// Claim and queue a transfer, releasing the endpoint again if it fails
+bool vendorh_edpt_arm(uint8_t dev_addr, uint8_t ep_addr, uint8_t *buf, uint16_t len);
+
+//--------------------------------------------------------------------+
+// Control transfers
+//--------------------------------------------------------------------+
+
+// Queue a control transfer without blocking. request and buffer must stay
+// valid until complete_cb is invoked. False if EP0 is busy.
+bool vendorh_control_xfer(uint8_t dev_addr, tusb_control_request_t const *request, uint8_t *buffer,
+                          tuh_xfer_cb_t complete_cb, uintptr_t user_data);
+
+// Times a failed vendorh_ctrl_send request is sent again before ctrl_done gets the error
+#ifndef CFG_TUH_VENDORH_CTRL_RETRIES
+#define CFG_TUH_VENDORH_CTRL_RETRIES 2
+#endif
+
+//--------------------------------------------------------------------+
+// IN endpoint error recovery
+//--------------------------------------------------------------------+
+
+// First retry delay, doubled on every consecutive failure
+#ifndef CFG_TUH_VENDORH_BACKOFF_MIN_MS
+#define CFG_TUH_VENDORH_BACKOFF_MIN_MS 8
+#endif
+
+#ifndef CFG_TUH_VENDORH_BACKOFF_MAX_MS
+#define CFG_TUH_VENDORH_BACKOFF_MAX_MS 1000
+#endif
+
+typedef enum
+{
+    VENDORH_LINK_UP = 0,
+    VENDORH_LINK_DEGRADED, // IN transfers fail, the driver keeps retrying
+} vendorh_link_t;
+
+typedef struct
+{
+    uint8_t link;       // vendorh_link_t
+    uint8_t ep_addr;    // endpoint that failed
+    uint8_t failures;   // consecutive failed transfers
+    uint8_t stalled;    // halt must be cleared before the next transfer
+    uint8_t clearing;   // CLEAR_FEATURE(ENDPOINT_HALT) in flight
+    uint8_t due;        // a retry is needed
+    uint8_t scheduled;  // retry_ms is valid
+    uint32_t retry_ms;
+    tusb_control_request_t request;
+} vendorh_recovery_t;
+
+// Record a failed transfer, true if the link just became degraded
+bool vendorh_recovery_fail(vendorh_recovery_t *rec, uint8_t ep_addr, xfer_result_t result);
+
+// Record a good report, true if the link just recovered
+bool vendorh_recovery_ok(vendorh_recovery_t *rec);
+
+//--------------------------------------------------------------------+
+// Class drivers
+//--------------------------------------------------------------------+
+
+// State shared by every driver interface, its first member named base
+typedef struct
+{
+    uint8_t connected;
+    uint8_t new_pad_data;
+    uint8_t itf_num;
+    uint8_t ep_in;
+    uint8_t ep_out;
+    uint8_t polling;       // IN transfer re-queued from xfer_cb, see vendorh_start_polling
+    uint8_t epin_idx;      // epin_buf used by the next IN transfer
+    uint8_t variant;       // returned by the class match hook, e.g. the model
+    uint8_t ctrl_inflight; // control transfer from vendorh_ctrl_send not completed yet
+    uint8_t ctrl_retries;  // resends left for the control transfer in flight
+    uint8_t mount_gen;     // tells control transfers of an earlier mount apart
+    uint16_t epin_size;
+    uint16_t epout_size;
+    uint32_t pad_seq;      // odd while pad, report_time and class data are being updated
+    vendorh_report_time_t report_time; // arrival of the last decoded report
+    tusb_control_request_t ctrl_request;
+} vendorh_itf_t;
+
+// Start of every driver device struct, its interfaces follow
+typedef struct
+{
+    uint8_t inst_count;
+    vendorh_epmap_t epmap;
+} vendorh_dev_t;
+
+// vendorh_class_t::id, tags control transfers back to their driver
+typedef enum
+{
+    VENDORH_CLASS_DENSHA = 0,
+    VENDORH_CLASS_GUNCON2,
+    VENDORH_CLASS_SBC,
+    VENDORH_CLASS_COUNT
+} vendorh_class_id_t;
+
+// vendorh_class_t::flags
+#define VENDORH_CLASS_REPORT_ON_CHANGE 0x01 // CFG_TUH_*_REPORT_ON_CHANGE
+
+// vendorh_class_t::match result for a device the driver does not handle
+#define VENDORH_NO_MATCH 0xFF
+
+// Largest driver pad and axis count, decoded on the stack before they are published
+#define VENDORH_PAD_MAX  32
+#define VENDORH_AXIS_MAX 8
+
+// Everything the core needs to know about a driver. Member offsets are
+// relative to the driver interface struct, optional ones are 0 when the
+// driver option is disabled. Hooks marked optional may be NULL.
+typedef struct
+{
+    uint8_t id;      // vendorh_class_id_t
+    uint8_t itf_max; // CFG_TUH_* interfaces per device
+    uint8_t flags;   // VENDORH_CLASS_*
+    char const *name;
+
+    // CFG_TUH_DEVICE_MAX device structs: a vendorh_dev_t, then itf_max
+    // interfaces of itf_size bytes each at itf_offset
+    void *devs;
+    uint16_t dev_size;
+    uint16_t itf_offset;
+    uint16_t itf_size;
+
+    uint16_t pad_offset;
+    uint16_t delta_offset;
+    uint8_t pad_size;
+    uint8_t delta_size;
+    uint16_t epin_offset;  // uint8_t epin_buf[2][epin_bufsize]
+    uint16_t epin_bufsize;
+    uint16_t epout_offset; // uint8_t epout_buf[epout_bufsize]
+    uint16_t epout_bufsize;
+
+    uint16_t stats_offset;    // vendorh_stats_t
+    uint16_t recovery_offset; // vendorh_recovery_t
+    uint16_t ring_idx_offset; // vendorh_ring_t
+    uint16_t ring_offset;     // ring_depth entries: timestamp_us, frame, seq, pad
+    uint16_t ring_entry_size;
+    uint16_t ring_depth;
+    uint8_t ring_entry_pad;   // offset of the pad in an entry
+    uint8_t axis_count;
+    uint16_t axis_offset;     // vendorh_axis_t[axis_count]
+    uint16_t axes_offset;     // int16_t[axis_count], guarded by pad_seq
+    uint8_t const *axis_src;  // pad member of every axis
+    vendorh_axis_cal_t const *axis_default; // calibration at mount, NULL if the mount hook sets it
+
+    // VENDORH_NO_MATCH, else a value kept in vendorh_itf_t::variant
+    uint8_t (*match)(uint16_t vid, uint16_t pid, tusb_desc_interface_t const *desc_itf);
+    // Interface configured, invokes the mount callback (optional)
+    void (*mount)(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf);
+    // Invokes the umount callback (optional)
+    void (*umount)(uint8_t dev_addr, uint8_t instance);
+    // Decode an IN report into pad, false if it must be ignored
+    bool (*decode)(vendorh_itf_t *itf, uint8_t const *report, uint32_t len, void *pad);
+    // Fill delta from two pads, true if anything changed
+    bool (*diff)(void const *prev, void const *pad, void *delta);
+    // Store data derived from the pad, inside the pad_seq write section
+    // that publishes it. No callbacks from here (optional)
+    void (*publish)(vendorh_itf_t *itf, void const *pad);
+    // A decoded report was published, for callbacks on derived data (optional)
+    void (*decoded)(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf);
+    // Invokes the report callbacks, new_pad_data is false for rejected reports
+    void (*notify)(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf, uint8_t const *report, uint16_t len);
+    // Fill the OUT endpoint buffer with the pending output, 0 if none (optional)
+    uint16_t (*build_out)(vendorh_itf_t *itf, uint8_t *buf);
+    // OUT endpoint transfer completed or failed (optional)
+    void (*out_done)(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf, xfer_result_t result, uint8_t const *buf, uint16_t len);
+    // vendorh_ctrl_send transfer completed, or failed after CFG_TUH_VENDORH_CTRL_RETRIES resends (optional)
+    void (*ctrl_done)(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf, xfer_result_t result, uint8_t const *buf, uint16_t len);
+    // Send outputs that are still pending, after a completion or an IN report (optional)
+    void (*flush)(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf);
+    // Periodic work from the driver task (optional)
+    void (*tick)(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf, uint32_t now_ms);
+
+    // weak application callbacks, NULL if not implemented
+    uint32_t (*time_us)(void);
+    void (*link)(uint8_t dev_addr, uint8_t instance, vendorh_link_t link);
+} vendorh_class_t;
+
+TU_ATTR_ALWAYS_INLINE static inline vendorh_dev_t *vendorh_get_dev(vendorh_class_t const *cls, uint8_t dev_addr)
+{
+    return (vendorh_dev_t *)((uint8_t *)cls->devs + (dev_addr - 1) * cls->dev_size);
+}
+
+TU_ATTR_ALWAYS_INLINE static inline vendorh_itf_t *vendorh_get_itf(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance)
+{
+    return (vendorh_itf_t *)((uint8_t *)vendorh_get_dev(cls, dev_addr) + cls->itf_offset + instance * cls->itf_size);
+}
+
+// Interface for the public API, NULL if dev_addr or instance is out of range or
+// not connected. Callbacks use vendorh_get_itf, their address is already checked.
+TU_ATTR_ALWAYS_INLINE static inline vendorh_itf_t *vendorh_find_itf(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance)
+{
+    if (dev_addr == 0 || dev_addr > CFG_TUH_DEVICE_MAX || instance >= cls->itf_max)
+        return NULL;
+
+    vendorh_itf_t *itf = vendorh_get_itf(cls, dev_addr, instance);
+    return itf->connected ? itf : NULL;
+}
+
+// Interface member at offset, see vendorh_class_t
+TU_ATTR_ALWAYS_INLINE static inline void *vendorh_itf_member(vendorh_itf_t *itf, uint16_t offset)
+{
+    return (uint8_t *)itf + offset;
+}
+
+TU_ATTR_ALWAYS_INLINE static inline uint32_t vendorh_time_us(vendorh_class_t const *cls)
+{
+    return cls->time_us ? cls->time_us() : 0;
+}
+
+// Class driver entry points, the drivers forward their usbh callbacks here
+void vendorh_init(vendorh_class_t const *cls);
+bool vendorh_open(vendorh_class_t const *cls, uint8_t dev_addr, tusb_desc_interface_t const *desc_itf, uint16_t max_len);
+bool vendorh_set_config(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t itf_num);
+bool vendorh_xfer_cb(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+void vendorh_close(vendorh_class_t const *cls, uint8_t dev_addr);
+
+// Interface API behind the tuh_* functions of the drivers
+bool vendorh_receive_report(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance);
+bool vendorh_get_pad(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, void *pad);
+bool vendorh_get_report_time(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, vendorh_report_time_t *report_time);
+bool vendorh_start_polling(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance);
+void vendorh_stop_polling(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance);
+bool vendorh_is_polling(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance);
+bool vendorh_ring_pop(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, void *entry);
+bool vendorh_get_stats(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, vendorh_stats_t *stats);
+void vendorh_reset_stats(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance);
+bool vendorh_get_axes(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, int16_t *axes);
+bool vendorh_set_axis_cal(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, uint8_t axis, vendorh_axis_cal_t const *cal);
+bool vendorh_get_axis_cal(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, uint8_t axis, vendorh_axis_cal_t *cal);
+bool vendorh_set_autocal(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, uint8_t axis, bool enable);
+// Must run in the USB host task context, it is a pad_seq writer like vendorh_xfer_cb
+// and rebuilds the axis tables the transfer callback reads
+void vendorh_task(vendorh_class_t const *cls, uint32_t now_ms);
+
+// Claim the OUT endpoint and send what build_out fills in. An endpoint that is
+// busy is not an error, the output is sent from xfer_cb when it completes.
+bool vendorh_out_flush(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance);
+
+// Send a control transfer for the interface and hand its result to the
+// ctrl_done hook. request is copied, buffer must stay valid until then.
+// False if another one is in flight or EP0 is busy.
+bool vendorh_ctrl_send(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance,
+                       tusb_control_request_t const *request, uint8_t *buffer);
+
+//--------------------------------------------------------------------+
+// Transfer trace capture and replay
+//--------------------------------------------------------------------+
+
+// Pass every completed transfer of all vendor drivers to the trace sink
+#ifndef CFG_TUH_VENDORH_TRACE
+#define CFG_TUH_VENDORH_TRACE 0
+#endif
+
+#if CFG_TUH_VENDORH_TRACE
+
+// A trace is a sequence of records, each followed by len data bytes.
+// Multi byte fields are little endian (the byte order of the capturing MCU).
+typedef struct TU_ATTR_PACKED
+{
+    uint32_t timestamp_us; // from the driver's tuh_*_time_us_cb
+    uint8_t dev_addr;
+    uint8_t instance;
+    uint8_t ep_addr;
+    uint8_t result;        // xfer_result_t
+    uint16_t len;
+} vendorh_trace_record_t;
+
+TU_VERIFY_STATIC(sizeof(vendorh_trace_record_t) == 10, "size is not correct");
+
+// Called from the USB host task, must not block
+typedef void (*vendorh_trace_sink_t)(vendorh_trace_record_t const *record, uint8_t const *data, void *ctx);
+
+// NULL stops capturing
+void vendorh_trace_set_sink(vendorh_trace_sink_t sink, void *ctx);
+
+// Used by the drivers from their xfer_cb
+void vendorh_trace_capture(uint32_t timestamp_us, uint8_t dev_addr, uint8_t instance, uint8_t ep_addr,
+                           xfer_result_t result, uint8_t const *data, uint32_t len);
+
+// Ready made sink: byte ring for a single consumer, e.g. a task writing to flash or UART
+typedef struct
+{
+    uint8_t *buf;
+    uint32_t size;    // power of two
+    uint32_t head;    // written by the sink only
+    uint32_t tail;    // written by the consumer only
+    uint32_t dropped; // records that did not fit
+} vendorh_trace_ring_t;
+
+void vendorh_trace_ring_init(vendorh_trace_ring_t *ring, uint8_t *buf, uint32_t size);
+void vendorh_trace_ring_sink(vendorh_trace_record_t const *record, uint8_t const *data, void *ctx);
+
+// Move whole records (header and data) into dst, returns the bytes copied
+uint32_t vendorh_trace_ring_drain(vendorh_trace_ring_t *ring, uint8_t *dst, uint32_t max_len);
+
+// Feeds one record to a driver, see tuh_*_replay
+typedef bool (*vendorh_trace_inject_t)(uint8_t dev_addr, uint8_t instance, uint8_t ep_addr, xfer_result_t result, uint8_t const *data, uint16_t len);
+
+// Replay a trace through inject. With wait_us the original spacing between
+// records is kept, without it they are fed at full speed.
+// Returns the number of records replayed.
+uint32_t vendorh_trace_replay(uint8_t const *trace, uint32_t size, vendorh_trace_inject_t inject, void (*wait_us)(uint32_t us));
+
+// Feed a captured transfer to a mounted instance as if it just completed.
+// data is decoded where it is, polling and queued transfers are not touched.
+// False for an OUT record while the OUT endpoint is busy.
+bool vendorh_replay(vendorh_class_t const *cls, uint8_t dev_addr, uint8_t instance, uint8_t ep_addr,
+                    xfer_result_t result, uint8_t const *data, uint16_t len);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TUSB_VENDORH_CORE_H_ */
@@ -7,63 +7,260 @@
 #include "class/hid/hid.h"
 #include "densha_host.h"
 
+#if CFG_TUH_DENSHA_RING_SIZE
+TU_VERIFY_STATIC((CFG_TUH_DENSHA_RING_SIZE & (CFG_TUH_DENSHA_RING_SIZE - 1)) == 0, "CFG_TUH_DENSHA_RING_SIZE must be a power of two");
+TU_VERIFY_STATIC(offsetof(densha_gamepad_entry_t, seq) == 8, "entry layout is not the one vendorh_core fills");
+#endif
+TU_VERIFY_STATIC(sizeof(densha_gamepad_t) <= VENDORH_PAD_MAX, "pad is too large");
+TU_VERIFY_STATIC(DENSHA_AXIS_COUNT <= VENDORH_AXIS_MAX, "too many axes");
+
 typedef struct
 {
-    uint8_t inst_count;
+    vendorh_dev_t base;
     denshah_interface_t instances[CFG_TUH_DENSHA];
 } denshah_device_t;
 
+TU_VERIFY_STATIC(sizeof(denshah_device_t) <= UINT16_MAX, "vendorh_class_t offsets are 16-bit");
+
 static denshah_device_t _denshah_dev[CFG_TUH_DEVICE_MAX];
 
-TU_ATTR_ALWAYS_INLINE static inline denshah_device_t *get_dev(uint8_t dev_addr)
+static vendorh_class_t const densha_class;
+
+//--------------------------------------------------------------------+
+// Supported models
+//--------------------------------------------------------------------+
+
+typedef struct
+{
+    uint16_t vid;
+    uint16_t pid;
+    densha_type_t type;
+    uint8_t report_len; // shortest valid IN report
+    bool commands;      // rumble and door lamp through the Type 2 EP0 commands
+    // false if the report must be ignored
+    bool (*decode)(uint8_t const *rdata, uint32_t len, densha_gamepad_t *pad);
+#if CFG_TUH_DENSHA_AXIS_CAL
+    vendorh_axis_cal_t axis_default[DENSHA_AXIS_COUNT]; // calibration at mount, 0 at rest
+#endif
+#if CFG_TUH_DENSHA_NOTCH
+    // raw lever value -> notch + 1, 0 between notches. NULL if not known
+    uint8_t const *power_notch;
+    uint8_t const *brake_notch;
+#endif
+} densha_model_t;
+
+#if CFG_TUH_DENSHA_MODEL_TYPE2
+static vendorh_field_t const type2_fields[] =
+{
+    VENDORH_FIELD(1, 0, 0, 0xFF, densha_gamepad_t, bBrake,   0),
+    VENDORH_FIELD(2, 0, 0, 0xFF, densha_gamepad_t, bPower,   0),
+    VENDORH_FIELD(3, 0, 0, 0xFF, densha_gamepad_t, bPedal,   0),
+    VENDORH_FIELD(4, 0, 0, 0xFF, densha_gamepad_t, bDpad,    0),
+    VENDORH_FIELD(5, 0, 0, 0xFF, densha_gamepad_t, bButtons, 0),
+};
+
+static bool decode_type2(uint8_t const *rdata, uint32_t len, densha_gamepad_t *pad)
 {
-    return &_denshah_dev[dev_addr - 1];
+    (void)len;
+
+    //0x00 is not a valid value for Brake. Ignore this report
+    //Can happen on first report right when the controller is connected
+    if (rdata[0] != 0x01 || rdata[1] == 0x00)
+        return false;
+
+    vendorh_decode_fields(type2_fields, TU_ARRAY_SIZE(type2_fields), rdata, pad);
+    return true;
 }
 
-TU_ATTR_ALWAYS_INLINE static inline denshah_interface_t *get_instance(uint8_t dev_addr, uint8_t instance)
+#if CFG_TUH_DENSHA_NOTCH
+static uint8_t const type2_power_notch[256] =
 {
-    return &_denshah_dev[dev_addr - 1].instances[instance];
+    [0x81] = 1, [0x6D] = 2, [0x54] = 3, [0x3F] = 4, [0x21] = 5, [0x00] = 6, // P0-P5
+};
+
+static uint8_t const type2_brake_notch[256] =
+{
+    [0x79] = 1, [0x8A] = 2, [0x94] = 3, [0x9A] = 4, [0xA2] = 5, // B0-B4
+    [0xA8] = 6, [0xAF] = 7, [0xB2] = 8, [0xB5] = 9,             // B5-B8
+    [0xB9] = DENSHA_BRAKE_EB + 1,
+};
+#endif
+#endif
+
+#if CFG_TUH_DENSHA_MODEL_SHINKANSEN
+// brake, power, horn, dpad, buttons D C B A SELECT START from bit 0
+static vendorh_field_t const shinkansen_fields[] =
+{
+    VENDORH_FIELD(0, 0, 0, 0xFF, densha_gamepad_t, bBrake,   0),
+    VENDORH_FIELD(1, 0, 0, 0xFF, densha_gamepad_t, bPower,   0),
+    VENDORH_FIELD(2, 0, 0, 0xFF, densha_gamepad_t, bPedal,   0),
+    VENDORH_FIELD(3, 0, 0, 0xFF, densha_gamepad_t, bDpad,    0),
+    VENDORH_FIELD(4, 0, 2, 0x03, densha_gamepad_t, bButtons, 0), // B A
+    VENDORH_FIELD(4, 0, 1, 0x01, densha_gamepad_t, bButtons, 2), // C
+    VENDORH_FIELD(4, 0, 0, 0x01, densha_gamepad_t, bButtons, 3), // D
+    VENDORH_FIELD(4, 0, 4, 0x03, densha_gamepad_t, bButtons, 4), // SELECT START
+};
+
+static bool decode_shinkansen(uint8_t const *rdata, uint32_t len, densha_gamepad_t *pad)
+{
+    (void)len;
+
+    vendorh_decode_fields(shinkansen_fields, TU_ARRAY_SIZE(shinkansen_fields), rdata, pad);
+    return true;
 }
 
-static uint8_t get_instance_id_by_epaddr(uint8_t dev_addr, uint8_t ep_addr)
+#if CFG_TUH_DENSHA_NOTCH
+static uint8_t const shinkansen_power_notch[256] =
+{
+    [0x12] = 1,  [0x24] = 2,  [0x36] = 3,  [0x48] = 4,  [0x5A] = 5,  // P0-P4
+    [0x6C] = 6,  [0x7E] = 7,  [0x90] = 8,  [0xA2] = 9,  [0xB4] = 10, // P5-P9
+    [0xC6] = 11, [0xD8] = 12, [0xEA] = 13, [0xFB] = 14,              // P10-P13
+};
+
+static uint8_t const shinkansen_brake_notch[256] =
 {
-    for (uint8_t inst = 0; inst < CFG_TUH_DENSHA; inst++)
+    [0x1C] = 1, [0x38] = 2, [0x54] = 3, [0x70] = 4, [0x8B] = 5, // B0-B4
+    [0xA7] = 6, [0xC3] = 7, [0xDF] = 8,                         // B5-B7
+    [0xFB] = DENSHA_BRAKE_EB + 1,
+};
+#endif
+#endif
+
+// Other controllers (Ryojouhen, multi train...) are added here
+// with a CFG_TUH_DENSHA_MODEL_* option, a densha_type_t and a decoder
+static densha_model_t const densha_models[] =
+{
+#if CFG_TUH_DENSHA_MODEL_TYPE2
+    {
+        .vid          = DENSHA_VID_TAITO,
+        .pid          = DENSHA_PID_PS2TYPE2,
+        .type         = TAITO_DENSYA_CON_T01,
+        .report_len   = 6,
+        .commands     = true,
+        .decode       = decode_type2,
+#if CFG_TUH_DENSHA_AXIS_CAL
+        // power decreases from P0 0x81 to P5 0x00, brake increases from B0 0x79 to EB 0xB9
+        .axis_default =
+        {
+            { .min = 0x00, .center = 0x81, .max = 0x81, .flags = VENDORH_AXIS_INVERT },
+            { .min = 0x79, .center = 0x79, .max = 0xB9, .flags = 0 },
+            { .min = 0,    .center = 128,  .max = 255,  .flags = 0 },
+        },
+#endif
+#if CFG_TUH_DENSHA_NOTCH
+        .power_notch  = type2_power_notch,
+        .brake_notch  = type2_brake_notch,
+#endif
+    },
+#endif
+#if CFG_TUH_DENSHA_MODEL_SHINKANSEN
     {
-        denshah_interface_t *hid = get_instance(dev_addr, inst);
+        .vid          = DENSHA_VID_TAITO,
+        .pid          = DENSHA_PID_PS2SHINKANSEN,
+        .type         = TAITO_DENSYA_SHINKANSEN,
+        .report_len   = 5,
+        .commands     = false, // outputs go through a different report, not supported yet
+        .decode       = decode_shinkansen,
+#if CFG_TUH_DENSHA_AXIS_CAL
+        // both levers increase: power from P0 0x12 to P13 0xFB, brake from B0 0x1C to EB 0xFB
+        .axis_default =
+        {
+            { .min = 0x12, .center = 0x12, .max = 0xFB, .flags = 0 },
+            { .min = 0x1C, .center = 0x1C, .max = 0xFB, .flags = 0 },
+            { .min = 0,    .center = 128,  .max = 255,  .flags = 0 },
+        },
+#endif
+#if CFG_TUH_DENSHA_NOTCH
+        .power_notch  = shinkansen_power_notch,
+        .brake_notch  = shinkansen_brake_notch,
+#endif
+    },
+#endif
+};
 
-        if ((ep_addr == hid->ep_in) || (ep_addr == hid->ep_out))
-            return inst;
-    }
+#define DENSHA_MODEL_COUNT TU_ARRAY_SIZE(densha_models)
+
+TU_VERIFY_STATIC(DENSHA_MODEL_COUNT > 0, "At least one CFG_TUH_DENSHA_MODEL_* must be enabled");
 
-    return 0xff;
+TU_ATTR_ALWAYS_INLINE static inline densha_model_t const *get_model(denshah_interface_t const *densha_itf)
+{
+    // only one model built in: its entry is a constant and calls through it are direct
+    if (DENSHA_MODEL_COUNT == 1)
+        return &densha_models[0];
+    return &densha_models[densha_itf->base.variant];
 }
 
-static uint8_t get_instance_id_by_itfnum(uint8_t dev_addr, uint8_t itf)
+TU_ATTR_ALWAYS_INLINE static inline bool model_decode(denshah_interface_t const *densha_itf, uint8_t const *rdata, uint32_t len, densha_gamepad_t *pad)
 {
-    for (uint8_t inst = 0; inst < CFG_TUH_DENSHA; inst++)
-    {
-        denshah_interface_t *hid = get_instance(dev_addr, inst);
+    densha_model_t const *model = get_model(densha_itf);
+    if (len < model->report_len)
+        return false;
+    return model->decode(rdata, len, pad);
+}
 
-        if ((hid->itf_num == itf) && (hid->ep_in || hid->ep_out))
-            return inst;
-    }
+TU_ATTR_ALWAYS_INLINE static inline denshah_interface_t *get_instance(uint8_t dev_addr, uint8_t instance)
+{
+    return &_denshah_dev[dev_addr - 1].instances[instance];
+}
 
-    return 0xff;
+// Instance for the public API, NULL if out of range or not connected
+TU_ATTR_ALWAYS_INLINE static inline denshah_interface_t *find_instance(uint8_t dev_addr, uint8_t instance)
+{
+    return (denshah_interface_t *)vendorh_find_itf(&densha_class, dev_addr, instance);
 }
 
-bool tuh_densha_receive_report(uint8_t dev_addr, uint8_t instance)
+#if CFG_TUH_DENSHA_NOTCH
+// Between two notches the last notch is kept and a transition flag is set.
+// True if a lever moved to another notch.
+static bool notch_decode(denshah_interface_t const *densha_itf, densha_gamepad_t const *pad, densha_notch_t *notch)
 {
-    denshah_interface_t *densha_itf = get_instance(dev_addr, instance);
-    TU_VERIFY(usbh_edpt_claim(dev_addr, densha_itf->ep_in));
+    densha_model_t const *model = get_model(densha_itf);
+    densha_notch_t const *prev = &densha_itf->notch;
 
-    if ( !usbh_edpt_xfer(dev_addr, densha_itf->ep_in, densha_itf->epin_buf, densha_itf->epin_size) )
-    {
-        usbh_edpt_claim(dev_addr, densha_itf->ep_in);
+    *notch = *prev;
+    if (!model->power_notch || !model->brake_notch)
         return false;
-    }
+
+    uint8_t const power = model->power_notch[pad->bPower];
+    uint8_t const brake = model->brake_notch[pad->bBrake];
+
+    notch->flags = 0;
+    if (power)
+        notch->power = power - 1;
+    else
+        notch->flags |= DENSHA_NOTCH_POWER_TRANSITION;
+
+    if (brake)
+        notch->brake = brake - 1;
+    else
+        notch->flags |= DENSHA_NOTCH_BRAKE_TRANSITION;
+
+    if (notch->brake == DENSHA_BRAKE_EB)
+        notch->flags |= DENSHA_NOTCH_EMERGENCY;
+
+    return notch->power != prev->power || notch->brake != prev->brake;
+}
+
+bool tuh_densha_get_notch(uint8_t dev_addr, uint8_t instance, densha_notch_t *notch)
+{
+    denshah_interface_t *densha_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(densha_itf);
+
+    vendorh_seq_read(&densha_itf->base.pad_seq, notch, &densha_itf->notch, sizeof(densha_notch_t));
+
     return true;
 }
+#endif
 
+#if CFG_TUH_DENSHA_AXIS_CAL
+// pad member of every densha_axis_t
+static uint8_t const axis_src[DENSHA_AXIS_COUNT] =
+{
+    offsetof(densha_gamepad_t, bPower),
+    offsetof(densha_gamepad_t, bBrake),
+    offsetof(densha_gamepad_t, bPedal),
+};
+#endif
 
 bool tuh_densha_set_rumble_power_handle(uint8_t dev_addr, uint8_t instance, bool state)
 {
@@ -82,13 +279,80 @@ bool tuh_densha_set_lamp(uint8_t dev_addr, uint8_t instance, bool state)
     return tuh_densha_send_report(dev_addr, instance, DOOR_LAMP, state);
 }
 
-bool tuh_densha_send_report(uint8_t dev_addr, uint8_t instance, densha_function_t function, bool state)
+// Record the newest state of a function. Nothing is sent if the device
+// already has that state or is being sent it.
+static void cmd_queue(denshah_interface_t *densha_itf, densha_function_t function, uint8_t state)
 {
-    uint8_t txbuf[2] = {
-        function, // 1: left rumble, 2: right rumble, 3: door lamp
-        state     // 0: off, 1: on
-    };
-    uint16_t len = sizeof(txbuf);
+    uint8_t const bit = (uint8_t)TU_BIT(function);
+    uint8_t const was_pending = densha_itf->cmd_pending & bit;
+
+    densha_itf->cmd_state[function - 1] = state;
+
+    if ((densha_itf->cmd_sent_valid & bit) && densha_itf->cmd_sent[function - 1] == state)
+    {
+        densha_itf->cmd_pending &= (uint8_t)~bit;
+    }
+    else if (!was_pending)
+    {
+        // a replaced command keeps its place in the queue
+        densha_itf->cmd_pending |= bit;
+        densha_itf->cmd_order[function - 1] = densha_itf->cmd_order_next++;
+    }
+
+#if CFG_TUH_DENSHA_STATS
+    // once per update: it replaced a pending command or was not needed
+    if (was_pending || !(densha_itf->cmd_pending & bit))
+        densha_itf->stats.out_coalesced++;
+#endif
+}
+
+static void outputs_get(uint8_t const *state, densha_outputs_t *outputs)
+{
+    outputs->power_rumble = state[LEFT_RUMBLE - 1];
+    outputs->brake_rumble = state[RIGHT_RUMBLE - 1];
+    outputs->door_lamp    = state[DOOR_LAMP - 1];
+}
+
+// Fire tuh_densha_outputs_sent_cb once everything from tuh_densha_set_outputs
+// went out or failed
+static void outputs_check_done(uint8_t dev_addr, uint8_t instance)
+{
+    denshah_interface_t *densha_itf = get_instance(dev_addr, instance);
+
+    if (!densha_itf->outputs_batch || densha_itf->cmd_pending || densha_itf->base.ctrl_inflight)
+        return;
+
+    densha_itf->outputs_batch = false;
+
+    if (tuh_densha_outputs_sent_cb)
+    {
+        densha_outputs_t outputs;
+        outputs_get(densha_itf->cmd_sent, &outputs);
+        tuh_densha_outputs_sent_cb(dev_addr, instance, &outputs, (xfer_result_t)densha_itf->outputs_result);
+    }
+}
+
+// Send the oldest pending function with its newest state. If EP0 is busy it
+// stays pending and is retried on the next command or IN report.
+static void cmd_send_next(uint8_t dev_addr, uint8_t instance)
+{
+    denshah_interface_t *densha_itf = get_instance(dev_addr, instance);
+
+    if (densha_itf->base.ctrl_inflight || !densha_itf->cmd_pending)
+        return;
+
+    uint8_t function = 0;
+    for (uint8_t f = LEFT_RUMBLE; f <= DOOR_LAMP; f++)
+    {
+        if ((densha_itf->cmd_pending & TU_BIT(f)) &&
+            (!function || (int8_t)(densha_itf->cmd_order[f - 1] - densha_itf->cmd_order[function - 1]) < 0))
+        {
+            function = f;
+        }
+    }
+
+    densha_itf->cmd_buf[0] = function;                             // 1: left rumble, 2: right rumble, 3: door lamp
+    densha_itf->cmd_buf[1] = densha_itf->cmd_state[function - 1]; // 0: off, 1: on
 
     tusb_control_request_t const request = {
         .bmRequestType_bit = {
@@ -99,169 +363,503 @@ bool tuh_densha_send_report(uint8_t dev_addr, uint8_t instance, densha_function_
         .bRequest = HID_REQ_CONTROL_SET_REPORT, // ??? HID_REQ_CONTROL_SET_REPORT   = 0x09, ///< Set Report ???
         .wValue   = tu_htole16(TU_U16(2, 1)), //0x0201, tu_htole16(TU_U16(desc_type, index))
         .wIndex   = 0,
-        .wLength  = len//0x0002
-    };
-    tuh_xfer_t xfer = {
-        .daddr       = dev_addr, // from mount callback
-        .ep_addr     = 0, // control endpoint has address 0
-        .setup       = &request,
-        .buffer      = txbuf,
-        //.complete_cb = complete_cb
+        .wLength  = sizeof(densha_itf->cmd_buf)//0x0002
     };
 
-    return tuh_control_xfer(&xfer);
+    if (vendorh_ctrl_send(&densha_class, dev_addr, instance, &request, densha_itf->cmd_buf))
+    {
+        densha_itf->cmd_pending &= (uint8_t)~TU_BIT(function);
+        densha_itf->cmd_sent[function - 1] = densha_itf->cmd_buf[1];
+        densha_itf->cmd_sent_valid |= (uint8_t)TU_BIT(function);
+    }
 }
 
-//--------------------------------------------------------------------+
-// USBH API
-//--------------------------------------------------------------------+
-void denshah_init(void)
+bool tuh_densha_send_report(uint8_t dev_addr, uint8_t instance, densha_function_t function, bool state)
 {
-    tu_memclr(_denshah_dev, sizeof(_denshah_dev));
+    denshah_interface_t *densha_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(densha_itf && get_model(densha_itf)->commands);
+    TU_VERIFY(function >= LEFT_RUMBLE && function <= DOOR_LAMP);
+
+    // a newer state replaces one still waiting for EP0
+    cmd_queue(densha_itf, function, state);
+
+    cmd_send_next(dev_addr, instance);
+    return true;
 }
 
-bool denshah_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *desc_itf, uint16_t max_len)
+bool tuh_densha_set_outputs(uint8_t dev_addr, uint8_t instance, densha_outputs_t const *outputs)
+{
+    denshah_interface_t *densha_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(densha_itf && get_model(densha_itf)->commands);
+
+    // only the functions that changed are queued, back to back on EP0
+    cmd_queue(densha_itf, LEFT_RUMBLE, outputs->power_rumble);
+    cmd_queue(densha_itf, RIGHT_RUMBLE, outputs->brake_rumble);
+    cmd_queue(densha_itf, DOOR_LAMP, outputs->door_lamp);
+    if (!densha_itf->outputs_batch)
+    {
+        densha_itf->outputs_batch = true;
+        densha_itf->outputs_result = XFER_RESULT_SUCCESS;
+    }
+
+    cmd_send_next(dev_addr, instance);
+    outputs_check_done(dev_addr, instance);
+    return true;
+}
+
+bool tuh_densha_get_outputs(uint8_t dev_addr, uint8_t instance, densha_outputs_t *outputs)
 {
-    TU_VERIFY(dev_addr <= CFG_TUH_DEVICE_MAX);
+    denshah_interface_t *densha_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(densha_itf);
+
+    outputs_get(densha_itf->cmd_state, outputs);
+    return true;
+}
 
-    densha_type_t type = TAITO_DENSYA_UNKNOWN;
+bool tuh_densha_outputs_busy(uint8_t dev_addr, uint8_t instance)
+{
+    denshah_interface_t *densha_itf = find_instance(dev_addr, instance);
+    return densha_itf && (densha_itf->cmd_pending || densha_itf->base.ctrl_inflight);
+}
 
-    uint16_t PID, VID;
-    tuh_vid_pid_get(dev_addr, &VID, &PID);
+#if CFG_TUH_DENSHA_RUMBLE_FX
+bool tuh_densha_rumble_fx(uint8_t dev_addr, uint8_t instance, densha_function_t motor, densha_rumble_fx_t const *fx)
+{
+    denshah_interface_t *densha_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(densha_itf && get_model(densha_itf)->commands);
+    TU_VERIFY(motor == LEFT_RUMBLE || motor == RIGHT_RUMBLE);
+
+    densha_rumble_motor_t *rumble = &densha_itf->rumble[motor - LEFT_RUMBLE];
+    rumble->fx = *fx;
+    rumble->elapsed_ms = 0;
+    rumble->acc = 0;
+    return true;
+}
 
-    if (VID == DENSHA_VID_TAITO)
+bool tuh_densha_rumble_intensity(uint8_t dev_addr, uint8_t instance, densha_function_t motor, uint8_t intensity)
+{
+    densha_rumble_fx_t const fx = {
+        .type      = intensity ? DENSHA_RUMBLE_FX_CONSTANT : DENSHA_RUMBLE_FX_OFF,
+        .intensity = intensity
+    };
+    return tuh_densha_rumble_fx(dev_addr, instance, motor, &fx);
+}
+
+// Intensity the effect asks for at this point, 0 once it is over
+static uint8_t rumble_level(densha_rumble_motor_t *rumble)
+{
+    densha_rumble_fx_t *fx = &rumble->fx;
+
+    switch (fx->type)
     {
-        if (PID == DENSHA_PID_PS2TYPE2)
-            type = TAITO_DENSYA_CON_T01;
-    }
+    case DENSHA_RUMBLE_FX_CONSTANT:
+        return fx->intensity;
 
-    if (type == TAITO_DENSYA_UNKNOWN)
+    case DENSHA_RUMBLE_FX_PULSE:
     {
-        TU_LOG2("DENSHA: not implemented\n");
-        return false;
+        uint32_t const period = (uint32_t)fx->on_ms + fx->off_ms;
+        if (!period || (fx->count && rumble->elapsed_ms >= period * fx->count))
+            break;
+        return (rumble->elapsed_ms % period) < fx->on_ms ? fx->intensity : 0;
     }
 
-    TU_LOG2("DENSHA opening Interface %u (addr = %u)\r\n", desc_itf->bInterfaceNumber, dev_addr);
+    case DENSHA_RUMBLE_FX_DECAY:
+        if (rumble->elapsed_ms >= fx->decay_ms)
+            break;
+        return (uint8_t)(fx->intensity * (fx->decay_ms - rumble->elapsed_ms) / fx->decay_ms);
 
-    denshah_device_t *densha_dev = get_dev(dev_addr);
-    TU_ASSERT(densha_dev->inst_count < CFG_TUH_DENSHA, 0);
+    default:
+        return 0;
+    }
+
+    fx->type = DENSHA_RUMBLE_FX_OFF;
+    return 0;
+}
 
-    denshah_interface_t *densha_itf = get_instance(dev_addr, densha_dev->inst_count);
-    densha_itf->itf_num = desc_itf->bInterfaceNumber;
-    densha_itf->type = type;
+static void rumble_tick(uint8_t dev_addr, uint8_t instance, uint32_t now_ms)
+{
+    denshah_interface_t *densha_itf = get_instance(dev_addr, instance);
+    uint32_t const dt = now_ms - densha_itf->rumble_tick_ms;
 
-    //Parse descriptor for all endpoints and open them
-    uint8_t const *p_desc = (uint8_t const *)desc_itf;
-    int endpoint = 0;
-    int pos = 0;
-    while (endpoint < desc_itf->bNumEndpoints && pos < max_len)
+    if (densha_itf->rumble_running && dt < CFG_TUH_DENSHA_RUMBLE_TICK_MS)
+        return;
+
+    densha_itf->rumble_tick_ms = now_ms;
+
+    // refill the transfer budget, at most one transfer per motor can be saved up
+    uint32_t const budget = densha_itf->rumble_budget + TU_MIN(dt, 1000) * CFG_TUH_DENSHA_RUMBLE_MAX_XFER_PER_SEC;
+    densha_itf->rumble_budget = (uint16_t)TU_MIN(budget, 2000);
+
+    // effects start on the first tick that sees them, and a late task call
+    // slows them down instead of skipping over them
+    uint32_t const step = densha_itf->rumble_running ? TU_MIN(dt, 4 * CFG_TUH_DENSHA_RUMBLE_TICK_MS) : 0;
+    densha_itf->rumble_running = false;
+
+    for (uint8_t i = 0; i < 2; i++)
     {
-        if (tu_desc_type(p_desc) != TUSB_DESC_ENDPOINT)
-        {
-            pos += tu_desc_len(p_desc);
-            p_desc = tu_desc_next(p_desc);
+        densha_rumble_motor_t *rumble = &densha_itf->rumble[i];
+        if (rumble->fx.type == DENSHA_RUMBLE_FX_OFF && !rumble->on)
             continue;
-        }
-        tusb_desc_endpoint_t const *desc_ep = (tusb_desc_endpoint_t const *)p_desc;
-        TU_ASSERT(TUSB_DESC_ENDPOINT == desc_ep->bDescriptorType);
-        TU_ASSERT(tuh_edpt_open(dev_addr, desc_ep));
-        if (tu_edpt_dir(desc_ep->bEndpointAddress) == TUSB_DIR_OUT)
-        {
-            densha_itf->ep_out = desc_ep->bEndpointAddress;
-            densha_itf->epout_size = tu_edpt_packet_size(desc_ep);
-        }
-        else
+
+        rumble->elapsed_ms += step;
+
+        // first order sigma-delta: the motor is on for level/255 of the ticks,
+        // ticks skipped for lack of budget are made up for afterwards
+        int16_t acc = (int16_t)(rumble->acc + rumble_level(rumble) - (rumble->on ? 255 : 0));
+        rumble->acc = (int16_t)TU_MAX(TU_MIN(acc, 4 * 255), -4 * 255);
+
+        uint8_t const on = (rumble->fx.type != DENSHA_RUMBLE_FX_OFF) && rumble->acc > 0;
+        densha_itf->rumble_running = true;
+
+        // rumble->on only follows completed commands, a state that failed
+        // after its retries is neither pending nor sent and goes out again
+        uint8_t const bit = (uint8_t)TU_BIT(LEFT_RUMBLE + i);
+        bool const queued = densha_itf->cmd_state[i] == on && ((densha_itf->cmd_pending | densha_itf->cmd_sent_valid) & bit);
+        if (on == rumble->on || queued || densha_itf->rumble_budget < 1000)
+            continue;
+
+        if (tuh_densha_send_report(dev_addr, instance, (densha_function_t)(LEFT_RUMBLE + i), on))
         {
-            densha_itf->ep_in = desc_ep->bEndpointAddress;
-            densha_itf->epin_size = tu_edpt_packet_size(desc_ep);
+            densha_itf->rumble_budget -= 1000;
         }
-        endpoint++;
-        pos += tu_desc_len(p_desc);
-        p_desc = tu_desc_next(p_desc);
     }
+}
+#endif
 
-    densha_dev->inst_count++;
-    return true;
+//--------------------------------------------------------------------+
+// Class hooks
+//--------------------------------------------------------------------+
+
+static uint8_t densha_match(uint16_t vid, uint16_t pid, tusb_desc_interface_t const *desc_itf)
+{
+    (void)desc_itf;
+
+    uint8_t model = 0;
+    while (model < DENSHA_MODEL_COUNT && !(densha_models[model].vid == vid && densha_models[model].pid == pid))
+        model++;
+
+    return model == DENSHA_MODEL_COUNT ? VENDORH_NO_MATCH : model;
 }
 
-bool denshah_set_config(uint8_t dev_addr, uint8_t itf_num)
+static void densha_mount(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf)
 {
-    uint8_t instance = get_instance_id_by_itfnum(dev_addr, itf_num);
-    denshah_interface_t *densha_itf = get_instance(dev_addr, instance);
-    densha_itf->connected = true;
+    denshah_interface_t *densha_itf = (denshah_interface_t *)itf;
+    densha_itf->type = get_model(densha_itf)->type;
+
+#if CFG_TUH_DENSHA_AXIS_CAL
+    // the lever codes differ per model
+    for (uint8_t i = 0; i < DENSHA_AXIS_COUNT; i++)
+    {
+        vendorh_axis_init(&densha_itf->axis_cal[i], &get_model(densha_itf)->axis_default[i]);
+    }
+#endif
 
     if (tuh_densha_mount_cb)
     {
         tuh_densha_mount_cb(dev_addr, instance, densha_itf);
     }
+}
+
+static void densha_umount(uint8_t dev_addr, uint8_t instance)
+{
+    if (tuh_densha_umount_cb)
+    {
+        tuh_densha_umount_cb(dev_addr, instance);
+    }
+}
+
+static bool densha_decode(vendorh_itf_t *itf, uint8_t const *rdata, uint32_t len, void *pad)
+{
+    return model_decode((denshah_interface_t const *)itf, rdata, len, (densha_gamepad_t *)pad);
+}
+
+static bool densha_diff(void const *prev_pad, void const *new_pad, void *out)
+{
+    densha_gamepad_t const *prev = (densha_gamepad_t const *)prev_pad;
+    densha_gamepad_t const *pad = (densha_gamepad_t const *)new_pad;
+    densha_gamepad_delta_t *delta = (densha_gamepad_delta_t *)out;
+
+    delta->changed = 0;
+    if (pad->bButtons != prev->bButtons) delta->changed |= DENSHA_FIELD_BUTTONS;
+    if (pad->bDpad    != prev->bDpad)    delta->changed |= DENSHA_FIELD_DPAD;
+    if (pad->bPedal   != prev->bPedal)   delta->changed |= DENSHA_FIELD_PEDAL;
+    if (pad->bPower   != prev->bPower)   delta->changed |= DENSHA_FIELD_POWER;
+    if (pad->bBrake   != prev->bBrake)   delta->changed |= DENSHA_FIELD_BRAKE;
+
+    if (!delta->changed)
+        return false;
 
-    usbh_driver_set_config_complete(dev_addr, densha_itf->itf_num);
+    delta->pressed  = pad->bButtons & ~prev->bButtons;
+    delta->released = prev->bButtons & ~pad->bButtons;
     return true;
 }
 
-bool denshah_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+#if CFG_TUH_DENSHA_NOTCH
+static void densha_publish(vendorh_itf_t *itf, void const *pad)
 {
-    if (result != XFER_RESULT_SUCCESS)
+    denshah_interface_t *densha_itf = (denshah_interface_t *)itf;
+
+    densha_notch_t notch;
+    densha_itf->notch_changed = notch_decode(densha_itf, (densha_gamepad_t const *)pad, &notch);
+    densha_itf->notch = notch;
+}
+
+static void densha_decoded(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf)
+{
+    denshah_interface_t *densha_itf = (denshah_interface_t *)itf;
+
+    if (densha_itf->notch_changed && tuh_densha_notch_cb)
     {
-        TU_LOG1("Error: %d\n", result);
-        return false;
+        tuh_densha_notch_cb(dev_addr, instance, &densha_itf->notch);
     }
+}
+#endif
 
-    uint8_t const dir = tu_edpt_dir(ep_addr);
-    uint8_t const instance = get_instance_id_by_epaddr(dev_addr, ep_addr);
-    denshah_interface_t *densha_itf = get_instance(dev_addr, instance);
-    densha_gamepad_t *pad = &densha_itf->pad;
-    uint8_t *rdata = densha_itf->epin_buf;
+static void densha_notify(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf, uint8_t const *report, uint16_t len)
+{
+    denshah_interface_t *densha_itf = (denshah_interface_t *)itf;
 
-    if (dir == TUSB_DIR_IN)
+    if (itf->new_pad_data && tuh_densha_pad_received_cb)
     {
-        TU_LOG2("Get Report callback (%u, %u, %u bytes)\r\n", dev_addr, instance, xferred_bytes);
-        TU_LOG2_MEM(densha_itf->epin_buf, xferred_bytes, 2);
-        if (densha_itf->type == TAITO_DENSYA_CON_T01)
-        {
-             //0x00 is not a valid value for Brake. Ignore this report
-             //Can happen on first report right when the controller is connected
-            if (rdata[0] == 0x01 && rdata[1] != 0x00)
-            {
-                tu_memclr(pad, sizeof(densha_gamepad_t));
-                //uint16_t wButtons = rdata[5] << 8 | rdata[4];
-
-                pad->bBrake   = rdata[1];
-                pad->bPower   = rdata[2];
-                pad->bPedal   = rdata[3];
-                pad->bDpad    = rdata[4];
-                pad->bButtons = rdata[5];
-
-                densha_itf->new_pad_data = true;
-            }
-        } 
-        tuh_densha_report_received_cb(dev_addr, instance, (const uint8_t *)densha_itf, sizeof(denshah_interface_t));
-        densha_itf->new_pad_data = false;
+        tuh_densha_pad_received_cb(dev_addr, instance, &densha_itf->pad, &densha_itf->delta, report, len);
     }
-    else
+    if (tuh_densha_report_received_cb)
     {
-        if (tuh_densha_report_sent_cb)
-        {
-            tuh_densha_report_sent_cb(dev_addr, instance, densha_itf->epout_buf, xferred_bytes);
-        }
+        tuh_densha_report_received_cb(dev_addr, instance, (const uint8_t *)densha_itf, sizeof(denshah_interface_t));
     }
+}
 
-    return true;
+static void densha_out_done(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf, xfer_result_t result, uint8_t const *buf, uint16_t len)
+{
+    (void)itf;
+    if (result == XFER_RESULT_SUCCESS && tuh_densha_report_sent_cb)
+    {
+        tuh_densha_report_sent_cb(dev_addr, instance, buf, len);
+    }
 }
 
-void denshah_close(uint8_t dev_addr)
+static void densha_ctrl_done(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf, xfer_result_t result, uint8_t const *buf, uint16_t len)
 {
-    TU_VERIFY(dev_addr <= CFG_TUH_DEVICE_MAX, );
-    denshah_device_t *densha_dev = get_dev(dev_addr);
+    denshah_interface_t *densha_itf = (denshah_interface_t *)itf;
 
-    for (uint8_t inst = 0; inst < densha_dev->inst_count; inst++)
+    if (result != XFER_RESULT_SUCCESS)
     {
-        if (tuh_densha_umount_cb)
+        // device state is unknown now, send it again on the next request
+        densha_itf->cmd_sent_valid &= (uint8_t)~TU_BIT(densha_itf->cmd_buf[0]);
+        if (densha_itf->outputs_batch && densha_itf->outputs_result == XFER_RESULT_SUCCESS)
         {
-            tuh_densha_umount_cb(dev_addr, inst);
+            densha_itf->outputs_result = (uint8_t)result;
         }
+        if (tuh_densha_report_failed_cb)
+        {
+            tuh_densha_report_failed_cb(dev_addr, instance, buf, len, result);
+        }
+        return;
     }
-    tu_memclr(densha_dev, sizeof(denshah_device_t));
+
+#if CFG_TUH_DENSHA_RUMBLE_FX
+    if (densha_itf->cmd_buf[0] != DOOR_LAMP)
+    {
+        densha_itf->rumble[densha_itf->cmd_buf[0] - LEFT_RUMBLE].on = densha_itf->cmd_buf[1];
+    }
+#endif
+
+    if (tuh_densha_report_sent_cb)
+    {
+        tuh_densha_report_sent_cb(dev_addr, instance, buf, len);
+    }
+}
+
+// Retry commands that found EP0 busy
+static void densha_flush(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf)
+{
+    (void)itf;
+    cmd_send_next(dev_addr, instance);
+    outputs_check_done(dev_addr, instance);
+}
+
+#if CFG_TUH_DENSHA_RUMBLE_FX
+static void densha_tick(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf, uint32_t now_ms)
+{
+    (void)itf;
+    rumble_tick(dev_addr, instance, now_ms);
+}
+#endif
+
+static vendorh_class_t const densha_class =
+{
+    .id              = VENDORH_CLASS_DENSHA,
+    .itf_max         = CFG_TUH_DENSHA,
+    .flags           = CFG_TUH_DENSHA_REPORT_ON_CHANGE ? VENDORH_CLASS_REPORT_ON_CHANGE : 0,
+    .name            = "DENSHA",
+    .devs            = _denshah_dev,
+    .dev_size        = sizeof(denshah_device_t),
+    .itf_offset      = offsetof(denshah_device_t, instances),
+    .itf_size        = sizeof(denshah_interface_t),
+    .pad_offset      = offsetof(denshah_interface_t, pad),
+    .delta_offset    = offsetof(denshah_interface_t, delta),
+    .pad_size        = sizeof(densha_gamepad_t),
+    .delta_size      = sizeof(densha_gamepad_delta_t),
+    .epin_offset     = offsetof(denshah_interface_t, epin_buf),
+    .epin_bufsize    = CFG_TUH_DENSHA_EPIN_BUFSIZE,
+    .epout_offset    = offsetof(denshah_interface_t, epout_buf),
+    .epout_bufsize   = CFG_TUH_DENSHA_EPOUT_BUFSIZE,
+#if CFG_TUH_DENSHA_STATS
+    .stats_offset    = offsetof(denshah_interface_t, stats),
+#endif
+#if CFG_TUH_DENSHA_RECOVERY
+    .recovery_offset = offsetof(denshah_interface_t, recovery),
+#endif
+#if CFG_TUH_DENSHA_RING_SIZE
+    .ring_idx_offset = offsetof(denshah_interface_t, ring_idx),
+    .ring_offset     = offsetof(denshah_interface_t, ring),
+    .ring_entry_size = sizeof(densha_gamepad_entry_t),
+    .ring_depth      = CFG_TUH_DENSHA_RING_SIZE,
+    .ring_entry_pad  = offsetof(densha_gamepad_entry_t, pad),
+#endif
+#if CFG_TUH_DENSHA_AXIS_CAL
+    .axis_count      = DENSHA_AXIS_COUNT,
+    .axis_offset     = offsetof(denshah_interface_t, axis_cal),
+    .axes_offset     = offsetof(denshah_interface_t, axes),
+    .axis_src        = axis_src,
+    .axis_default    = NULL, // per model, set by densha_mount
+#endif
+    .match           = densha_match,
+    .mount           = densha_mount,
+    .umount          = densha_umount,
+    .decode          = densha_decode,
+    .diff            = densha_diff,
+#if CFG_TUH_DENSHA_NOTCH
+    .publish         = densha_publish,
+    .decoded         = densha_decoded,
+#endif
+    .notify          = densha_notify,
+    .out_done        = densha_out_done,
+    .ctrl_done       = densha_ctrl_done,
+    .flush           = densha_flush,
+#if CFG_TUH_DENSHA_RUMBLE_FX
+    .tick            = densha_tick,
+#endif
+    .time_us         = tuh_densha_time_us_cb,
+    .link            = tuh_densha_link_cb,
+};
+
+//--------------------------------------------------------------------+
+// Interface API
+//--------------------------------------------------------------------+
+
+bool tuh_densha_get_state(uint8_t dev_addr, uint8_t instance, densha_gamepad_t *pad)
+{
+    return vendorh_get_pad(&densha_class, dev_addr, instance, pad);
+}
+
+bool tuh_densha_get_report_time(uint8_t dev_addr, uint8_t instance, vendorh_report_time_t *report_time)
+{
+    return vendorh_get_report_time(&densha_class, dev_addr, instance, report_time);
+}
+
+#if CFG_TUH_DENSHA_AXIS_CAL
+bool tuh_densha_get_axes(uint8_t dev_addr, uint8_t instance, int16_t *axes)
+{
+    return vendorh_get_axes(&densha_class, dev_addr, instance, axes);
+}
+
+bool tuh_densha_set_axis_cal(uint8_t dev_addr, uint8_t instance, densha_axis_t axis, vendorh_axis_cal_t const *cal)
+{
+    return vendorh_set_axis_cal(&densha_class, dev_addr, instance, (uint8_t)axis, cal);
+}
+
+bool tuh_densha_get_axis_cal(uint8_t dev_addr, uint8_t instance, densha_axis_t axis, vendorh_axis_cal_t *cal)
+{
+    return vendorh_get_axis_cal(&densha_class, dev_addr, instance, (uint8_t)axis, cal);
+}
+
+bool tuh_densha_axis_autocal(uint8_t dev_addr, uint8_t instance, densha_axis_t axis, bool enable)
+{
+    return vendorh_set_autocal(&densha_class, dev_addr, instance, (uint8_t)axis, enable);
+}
+#endif
+
+#if CFG_TUH_DENSHA_STATS
+bool tuh_densha_get_stats(uint8_t dev_addr, uint8_t instance, vendorh_stats_t *stats)
+{
+    return vendorh_get_stats(&densha_class, dev_addr, instance, stats);
+}
+
+void tuh_densha_reset_stats(uint8_t dev_addr, uint8_t instance)
+{
+    vendorh_reset_stats(&densha_class, dev_addr, instance);
+}
+#endif
+
+bool tuh_densha_receive_report(uint8_t dev_addr, uint8_t instance)
+{
+    return vendorh_receive_report(&densha_class, dev_addr, instance);
+}
+
+#if CFG_TUH_DENSHA_AUTO_POLL
+bool tuh_densha_start_polling(uint8_t dev_addr, uint8_t instance)
+{
+    return vendorh_start_polling(&densha_class, dev_addr, instance);
+}
+
+void tuh_densha_stop_polling(uint8_t dev_addr, uint8_t instance)
+{
+    vendorh_stop_polling(&densha_class, dev_addr, instance);
+}
+
+bool tuh_densha_is_polling(uint8_t dev_addr, uint8_t instance)
+{
+    return vendorh_is_polling(&densha_class, dev_addr, instance);
+}
+#endif
+
+#if CFG_TUH_DENSHA_RING_SIZE
+bool tuh_densha_ring_pop(uint8_t dev_addr, uint8_t instance, densha_gamepad_entry_t *entry)
+{
+    return vendorh_ring_pop(&densha_class, dev_addr, instance, entry);
+}
+#endif
+
+void tuh_densha_task(uint32_t now_ms)
+{
+    vendorh_task(&densha_class, now_ms);
+}
+
+#if CFG_TUH_VENDORH_TRACE
+bool tuh_densha_replay(uint8_t dev_addr, uint8_t instance, uint8_t ep_addr, xfer_result_t result, uint8_t const *data, uint16_t len)
+{
+    return vendorh_replay(&densha_class, dev_addr, instance, ep_addr, result, data, len);
+}
+#endif
+
+//--------------------------------------------------------------------+
+// USBH API
+//--------------------------------------------------------------------+
+void denshah_init(void)
+{
+    vendorh_init(&densha_class);
+}
+
+bool denshah_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *desc_itf, uint16_t max_len)
+{
+    (void)rhport;
+    return vendorh_open(&densha_class, dev_addr, desc_itf, max_len);
+}
+
+bool denshah_set_config(uint8_t dev_addr, uint8_t itf_num)
+{
+    return vendorh_set_config(&densha_class, dev_addr, itf_num);
+}
+
+bool denshah_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+    return vendorh_xfer_cb(&densha_class, dev_addr, ep_addr, result, xferred_bytes);
+}
+
+void denshah_close(uint8_t dev_addr)
+{
+    vendorh_close(&densha_class, dev_addr);
 }
 
 #endif
@@ -10,6 +10,8 @@
 #ifndef _TUSB_DENSHA_HOST_H_
 #define _TUSB_DENSHA_HOST_H_
 
+#include "../common/vendorh_core.h"
+
 #ifdef __cplusplus
  extern "C" {
 #endif
@@ -26,8 +28,71 @@
 #define CFG_TUH_DENSHA_EPOUT_BUFSIZE 64
 #endif
 
-#define DENSHA_VID_TAITO    0x0AE4
-#define DENSHA_PID_PS2TYPE2 0x0004
+// Re-queue the IN transfer from the xfer callback so every bInterval is used
+#ifndef CFG_TUH_DENSHA_AUTO_POLL
+#define CFG_TUH_DENSHA_AUTO_POLL 0
+#endif
+
+// Only invoke tuh_densha_report_received_cb when the decoded pad changed
+#ifndef CFG_TUH_DENSHA_REPORT_ON_CHANGE
+#define CFG_TUH_DENSHA_REPORT_ON_CHANGE 0
+#endif
+
+// Depth of the per-instance ring of decoded pads (power of two, 0 to disable)
+#ifndef CFG_TUH_DENSHA_RING_SIZE
+#define CFG_TUH_DENSHA_RING_SIZE 0
+#endif
+
+
+// Decode bPower/bBrake into notch positions, see densha_notch_t
+#ifndef CFG_TUH_DENSHA_NOTCH
+#define CFG_TUH_DENSHA_NOTCH 0
+#endif
+
+// Normalized signed 16-bit axes through per-axis calibration tables,
+// 512 bytes of RAM per axis and instance
+#ifndef CFG_TUH_DENSHA_AXIS_CAL
+#define CFG_TUH_DENSHA_AXIS_CAL 0
+#endif
+
+// Per-instance counters and latency histograms, see tuh_densha_get_stats
+#ifndef CFG_TUH_DENSHA_STATS
+#define CFG_TUH_DENSHA_STATS 0
+#endif
+
+// Clear halts and re-arm failed IN transfers with backoff, driven by tuh_densha_task
+#ifndef CFG_TUH_DENSHA_RECOVERY
+#define CFG_TUH_DENSHA_RECOVERY 0
+#endif
+
+// Software rumble intensity and pattern engine, driven by tuh_densha_task
+#ifndef CFG_TUH_DENSHA_RUMBLE_FX
+#define CFG_TUH_DENSHA_RUMBLE_FX 0
+#endif
+
+// Update period of the rumble engine
+#ifndef CFG_TUH_DENSHA_RUMBLE_TICK_MS
+#define CFG_TUH_DENSHA_RUMBLE_TICK_MS 20
+#endif
+
+// Most rumble control transfers per second and instance, both motors together
+#ifndef CFG_TUH_DENSHA_RUMBLE_MAX_XFER_PER_SEC
+#define CFG_TUH_DENSHA_RUMBLE_MAX_XFER_PER_SEC 20
+#endif
+
+// Models compiled into the driver, see densha_models in densha_host.c.
+// With a single model the report decoder is called directly.
+#ifndef CFG_TUH_DENSHA_MODEL_TYPE2
+#define CFG_TUH_DENSHA_MODEL_TYPE2 1
+#endif
+
+#ifndef CFG_TUH_DENSHA_MODEL_SHINKANSEN
+#define CFG_TUH_DENSHA_MODEL_SHINKANSEN 1
+#endif
+
+#define DENSHA_VID_TAITO         0x0AE4
+#define DENSHA_PID_PS2TYPE2      0x0004
+#define DENSHA_PID_PS2SHINKANSEN 0x0005
 
 #define DENSHA_GAMEPAD_B      0x01
 #define DENSHA_GAMEPAD_A      0x02
@@ -47,10 +112,56 @@ typedef struct densha_gamepad
     uint8_t bBrake;
 } densha_gamepad_t;
 
+// densha_gamepad_delta_t::changed bits
+#define DENSHA_FIELD_BUTTONS 0x01
+#define DENSHA_FIELD_DPAD    0x02
+#define DENSHA_FIELD_PEDAL   0x04
+#define DENSHA_FIELD_POWER   0x08
+#define DENSHA_FIELD_BRAKE   0x10
+
+typedef struct
+{
+    uint8_t changed;  // DENSHA_FIELD_* that differ from the previous pad
+    uint8_t pressed;  // bButtons bits that went from 0 to 1
+    uint8_t released; // bButtons bits that went from 1 to 0
+} densha_gamepad_delta_t;
+
+typedef enum
+{
+    DENSHA_AXIS_POWER,
+    DENSHA_AXIS_BRAKE,
+    DENSHA_AXIS_PEDAL,
+    DENSHA_AXIS_COUNT
+} densha_axis_t;
+
+typedef struct
+{
+    uint32_t timestamp_us; // from tuh_densha_time_us_cb
+    uint32_t frame;        // host SOF frame number
+    uint32_t seq;          // increments on every decoded report, gaps mean dropped entries
+    densha_gamepad_t pad;
+} densha_gamepad_entry_t;
+
+// densha_notch_t::brake of the emergency brake, past the last service notch
+#define DENSHA_BRAKE_EB 9
+
+// densha_notch_t::flags
+#define DENSHA_NOTCH_EMERGENCY         0x01 // brake lever at EB
+#define DENSHA_NOTCH_POWER_TRANSITION  0x02 // power lever between two notches
+#define DENSHA_NOTCH_BRAKE_TRANSITION  0x04 // brake lever between two notches
+
+typedef struct
+{
+    uint8_t power; // P0 = 0 ... P5 = 5 (P13 = 13 on the Shinkansen controller), last notch passed while in transition
+    uint8_t brake; // B0 = 0 ... B8 = 8 (B7 = 7 on the Shinkansen controller), DENSHA_BRAKE_EB
+    uint8_t flags; // DENSHA_NOTCH_*
+} densha_notch_t;
+
 typedef enum
 {
     TAITO_DENSYA_UNKNOWN = 0,
-    TAITO_DENSYA_CON_T01
+    TAITO_DENSYA_CON_T01,
+    TAITO_DENSYA_SHINKANSEN
 } densha_type_t;
 
 typedef enum
@@ -62,39 +173,179 @@ typedef enum
 
 typedef struct
 {
+    bool power_rumble; // LEFT_RUMBLE
+    bool brake_rumble; // RIGHT_RUMBLE
+    bool door_lamp;    // DOOR_LAMP
+} densha_outputs_t;
+
+typedef enum
+{
+    DENSHA_RUMBLE_FX_OFF = 0,
+    DENSHA_RUMBLE_FX_CONSTANT, // motor on for intensity/255 of the time
+    DENSHA_RUMBLE_FX_PULSE,    // on_ms at intensity, off_ms off, count times (0: forever)
+    DENSHA_RUMBLE_FX_DECAY,    // intensity fading to 0 over decay_ms
+} densha_rumble_fx_type_t;
+
+typedef struct
+{
+    densha_rumble_fx_type_t type;
+    uint8_t intensity;
+    uint8_t count;
+    uint16_t on_ms;
+    uint16_t off_ms;
+    uint16_t decay_ms;
+} densha_rumble_fx_t;
+
+typedef struct
+{
+    densha_rumble_fx_t fx;
+    uint32_t elapsed_ms;
+    int16_t acc; // sigma-delta error, turns intensity into on/off
+    uint8_t on;  // state the motor last acknowledged
+} densha_rumble_motor_t;
+
+typedef struct
+{
+    vendorh_itf_t base; // connection, endpoints and pad_seq, base.variant indexes densha_models
     densha_type_t type;
     densha_gamepad_t pad;
-    uint8_t connected;
-    uint8_t new_pad_data;
-    uint8_t itf_num;
-    uint8_t ep_in;
-    uint8_t ep_out;
-
-    uint16_t epin_size;
-    uint16_t epout_size;
+    densha_gamepad_delta_t delta; // pad changes made by the last report
+#if CFG_TUH_DENSHA_NOTCH
+    densha_notch_t notch;                // guarded by base.pad_seq
+    uint8_t notch_changed;               // the last report moved a lever to another notch
+#endif
+#if CFG_TUH_DENSHA_AXIS_CAL
+    int16_t axes[DENSHA_AXIS_COUNT];       // normalized pad axes, guarded by base.pad_seq
+    vendorh_axis_t axis_cal[DENSHA_AXIS_COUNT];
+#endif
 
-    uint8_t epin_buf[CFG_TUH_DENSHA_EPIN_BUFSIZE];
+    // IN transfers alternate between the two buffers so the next one
+    // can be queued while the previous report is still being decoded
+    uint8_t epin_buf[2][CFG_TUH_DENSHA_EPIN_BUFSIZE];
     uint8_t epout_buf[CFG_TUH_DENSHA_EPOUT_BUFSIZE];
+
+    // control transfer commands, newest state per function wins
+    uint8_t cmd_buf[2];      // command being sent, function and state
+    uint8_t cmd_state[3];    // newest state per densha_function_t
+    uint8_t cmd_pending;     // TU_BIT(densha_function_t) waiting for EP0
+    uint8_t cmd_order[3];    // queue position per pending densha_function_t
+    uint8_t cmd_order_next;
+    uint8_t cmd_sent[3];     // last state sent per densha_function_t
+    uint8_t cmd_sent_valid;  // TU_BIT(densha_function_t) with a known cmd_sent
+    uint8_t outputs_batch;   // tuh_densha_set_outputs waiting to complete
+    uint8_t outputs_result;  // xfer_result_t of that batch, the first failure is kept
+
+#if CFG_TUH_DENSHA_RUMBLE_FX
+    densha_rumble_motor_t rumble[2]; // LEFT_RUMBLE, RIGHT_RUMBLE
+    uint32_t rumble_tick_ms;         // last tick that ran
+    uint8_t rumble_running;          // an effect is playing, its clock advances from rumble_tick_ms
+    uint16_t rumble_budget;          // transfers allowed, in 1/1000
+#endif
+
+#if CFG_TUH_DENSHA_RING_SIZE
+    // single producer (USB task) / single consumer ring
+    vendorh_ring_t ring_idx;
+    densha_gamepad_entry_t ring[CFG_TUH_DENSHA_RING_SIZE];
+#endif
+
+#if CFG_TUH_DENSHA_STATS
+    vendorh_stats_t stats;
+#endif
+
+#if CFG_TUH_DENSHA_RECOVERY
+    vendorh_recovery_t recovery;
+#endif
 } denshah_interface_t;
 
 //--------------------------------------------------------------------+
 // Callbacks
 //--------------------------------------------------------------------+
 
-void tuh_densha_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
+// Implement either one (or both) of the report callbacks.
+// pad_received is only invoked for valid reports and gets the decoded pad,
+// what changed since the previous one and the raw report, without copies.
+TU_ATTR_WEAK void tuh_densha_pad_received_cb(uint8_t dev_addr, uint8_t instance, densha_gamepad_t const *pad, densha_gamepad_delta_t const *delta, uint8_t const *report, uint16_t len);
+// report points to the whole denshah_interface_t
+TU_ATTR_WEAK void tuh_densha_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
 TU_ATTR_WEAK void tuh_densha_report_sent_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
+// A command could not be sent after CFG_TUH_VENDORH_CTRL_RETRIES resends
+TU_ATTR_WEAK void tuh_densha_report_failed_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len, xfer_result_t result);
 TU_ATTR_WEAK void tuh_densha_umount_cb(uint8_t dev_addr, uint8_t instance);
+// All outputs changed by tuh_densha_set_outputs were sent, result is not
+// XFER_RESULT_SUCCESS if one of them still failed after its retries.
+// outputs holds the state the device was sent.
+TU_ATTR_WEAK void tuh_densha_outputs_sent_cb(uint8_t dev_addr, uint8_t instance, densha_outputs_t const *outputs, xfer_result_t result);
 TU_ATTR_WEAK void tuh_densha_mount_cb(uint8_t dev_addr, uint8_t instance, const denshah_interface_t *densha_itf);
 
+// A lever settled on another notch, not invoked for transitions between notches
+TU_ATTR_WEAK void tuh_densha_notch_cb(uint8_t dev_addr, uint8_t instance, densha_notch_t const *notch);
+
+// Microsecond clock used to timestamp reports, e.g. time_us_32() on RP2040
+TU_ATTR_WEAK uint32_t tuh_densha_time_us_cb(void);
+
+// IN transfers started failing (VENDORH_LINK_DEGRADED) or work again (VENDORH_LINK_UP)
+TU_ATTR_WEAK void tuh_densha_link_cb(uint8_t dev_addr, uint8_t instance, vendorh_link_t link);
+
 //--------------------------------------------------------------------+
 // Interface API
 //--------------------------------------------------------------------+
 
 bool tuh_densha_receive_report(uint8_t dev_addr, uint8_t instance);
-bool tuh_densha_send_report(uint8_t dev_addr, uint8_t instance, uint8_t function, bool state);
+// Copy of the latest decoded pad, safe to call from any core or task
+bool tuh_densha_get_state(uint8_t dev_addr, uint8_t instance, densha_gamepad_t *pad);
+// Arrival time and SOF frame of the report the pad was decoded from
+bool tuh_densha_get_report_time(uint8_t dev_addr, uint8_t instance, vendorh_report_time_t *report_time);
+#if CFG_TUH_DENSHA_NOTCH
+// Latest lever notches, safe to call from any core or task
+bool tuh_densha_get_notch(uint8_t dev_addr, uint8_t instance, densha_notch_t *notch);
+#endif
+#if CFG_TUH_DENSHA_AXIS_CAL
+// Normalized copy of the latest pad axes, DENSHA_AXIS_COUNT values indexed by densha_axis_t
+bool tuh_densha_get_axes(uint8_t dev_addr, uint8_t instance, int16_t *axes);
+bool tuh_densha_set_axis_cal(uint8_t dev_addr, uint8_t instance, densha_axis_t axis, vendorh_axis_cal_t const *cal);
+bool tuh_densha_get_axis_cal(uint8_t dev_addr, uint8_t instance, densha_axis_t axis, vendorh_axis_cal_t *cal);
+// Learn min/max from the next reports, move the axis to both ends
+bool tuh_densha_axis_autocal(uint8_t dev_addr, uint8_t instance, densha_axis_t axis, bool enable);
+#endif
+#if CFG_TUH_DENSHA_STATS
+// Copy of the instance counters, call from the USB host task
+bool tuh_densha_get_stats(uint8_t dev_addr, uint8_t instance, vendorh_stats_t *stats);
+void tuh_densha_reset_stats(uint8_t dev_addr, uint8_t instance);
+#endif
+#if CFG_TUH_DENSHA_AUTO_POLL
+bool tuh_densha_start_polling(uint8_t dev_addr, uint8_t instance);
+void tuh_densha_stop_polling(uint8_t dev_addr, uint8_t instance);
+// False once polling stopped on its own, after a failed re-arm or an IN error without recovery
+bool tuh_densha_is_polling(uint8_t dev_addr, uint8_t instance);
+#endif
+#if CFG_TUH_DENSHA_RING_SIZE
+// Safe to call from another core than the one running the USB host task
+bool tuh_densha_ring_pop(uint8_t dev_addr, uint8_t instance, densha_gamepad_entry_t *entry);
+#endif
+// Commands are queued and sent one at a time on EP0, tuh_densha_report_sent_cb
+// fires when each one completes. Only the newest state of a function is sent.
+// Outputs are only known for the Type 2 controller, other models refuse them.
+bool tuh_densha_send_report(uint8_t dev_addr, uint8_t instance, densha_function_t function, bool state);
 bool tuh_densha_set_rumble_power_handle(uint8_t dev_addr, uint8_t instance, bool state);
 bool tuh_densha_set_rumble_brake_handle(uint8_t dev_addr, uint8_t instance, bool state);
 bool tuh_densha_set_lamp(uint8_t dev_addr, uint8_t instance, bool state);
+// Set every output at once, only changed outputs cost a control transfer
+bool tuh_densha_set_outputs(uint8_t dev_addr, uint8_t instance, densha_outputs_t const *outputs);
+bool tuh_densha_get_outputs(uint8_t dev_addr, uint8_t instance, densha_outputs_t *outputs);
+bool tuh_densha_outputs_busy(uint8_t dev_addr, uint8_t instance);
+#if CFG_TUH_DENSHA_RUMBLE_FX
+// Run a rumble effect on LEFT_RUMBLE or RIGHT_RUMBLE, type OFF stops it
+bool tuh_densha_rumble_fx(uint8_t dev_addr, uint8_t instance, densha_function_t motor, densha_rumble_fx_t const *fx);
+bool tuh_densha_rumble_intensity(uint8_t dev_addr, uint8_t instance, densha_function_t motor, uint8_t intensity);
+#endif
+// Call periodically from the main loop with a millisecond clock, in the
+// context that runs tuh_task: it shares driver state with the transfer callbacks
+void tuh_densha_task(uint32_t now_ms);
+#if CFG_TUH_VENDORH_TRACE
+// Feed a captured transfer to a mounted instance as if it just completed,
+// e.g. from vendorh_trace_replay in a host test
+bool tuh_densha_replay(uint8_t dev_addr, uint8_t instance, uint8_t ep_addr, xfer_result_t result, uint8_t const *data, uint16_t len);
+#endif
 
 //--------------------------------------------------------------------+
 // Internal Class Driver API
@@ -7,91 +7,222 @@
 #include "class/hid/hid.h"
 #include "guncon2_host.h"
 
+#if CFG_TUH_GUNCON2_RING_SIZE
+TU_VERIFY_STATIC((CFG_TUH_GUNCON2_RING_SIZE & (CFG_TUH_GUNCON2_RING_SIZE - 1)) == 0, "CFG_TUH_GUNCON2_RING_SIZE must be a power of two");
+TU_VERIFY_STATIC(offsetof(guncon2_gamepad_entry_t, seq) == 8, "entry layout is not the one vendorh_core fills");
+#endif
+TU_VERIFY_STATIC(sizeof(guncon2_gamepad_t) <= VENDORH_PAD_MAX, "pad is too large");
+
+#if CFG_TUH_GUNCON2_SHOT_QUEUE
+TU_VERIFY_STATIC((CFG_TUH_GUNCON2_SHOT_QUEUE & (CFG_TUH_GUNCON2_SHOT_QUEUE - 1)) == 0, "CFG_TUH_GUNCON2_SHOT_QUEUE must be a power of two");
+#endif
+
 typedef struct
 {
-    uint8_t inst_count;
+    vendorh_dev_t base;
     guncon2h_interface_t instances[CFG_TUH_GUNCON2];
 } guncon2h_device_t;
 
+TU_VERIFY_STATIC(sizeof(guncon2h_device_t) <= UINT16_MAX, "vendorh_class_t offsets are 16-bit");
+
 static guncon2h_device_t _guncon2h_dev[CFG_TUH_DEVICE_MAX];
 
-TU_ATTR_ALWAYS_INLINE static inline guncon2h_device_t *get_dev(uint8_t dev_addr)
+static vendorh_class_t const guncon2_class;
+
+static vendorh_field_t const guncon2_fields[] =
 {
-    return &_guncon2h_dev[dev_addr - 1];
-}
+    VENDORH_FIELD(1, 1, 2, 0x38, guncon2_gamepad_t, bButtons, 0),
+    VENDORH_FIELD(0, 1, 1, 0x07, guncon2_gamepad_t, bButtons, 0),
+    VENDORH_FIELD(0, 1, 4, 0x0F, guncon2_gamepad_t, bDpad,    0),
+    VENDORH_FIELD(2, 0, 0, 0xFF, guncon2_gamepad_t, wGunX,    0),
+    VENDORH_FIELD(3, 0, 0, 0xFF, guncon2_gamepad_t, wGunX,    8),
+    VENDORH_FIELD(4, 0, 0, 0xFF, guncon2_gamepad_t, wGunY,    0),
+    VENDORH_FIELD(5, 0, 0, 0xFF, guncon2_gamepad_t, wGunY,    8),
+};
 
 TU_ATTR_ALWAYS_INLINE static inline guncon2h_interface_t *get_instance(uint8_t dev_addr, uint8_t instance)
 {
     return &_guncon2h_dev[dev_addr - 1].instances[instance];
 }
 
-static uint8_t get_instance_id_by_epaddr(uint8_t dev_addr, uint8_t ep_addr)
+// Instance for the public API, NULL if out of range or not connected
+TU_ATTR_ALWAYS_INLINE static inline guncon2h_interface_t *find_instance(uint8_t dev_addr, uint8_t instance)
 {
-    for (uint8_t inst = 0; inst < CFG_TUH_GUNCON2; inst++)
-    {
-        guncon2h_interface_t *hid = get_instance(dev_addr, inst);
+    return (guncon2h_interface_t *)vendorh_find_itf(&guncon2_class, dev_addr, instance);
+}
 
-        if ((ep_addr == hid->ep_in) || (ep_addr == hid->ep_out))
-            return inst;
-    }
+bool tuh_guncon2_n_ready(uint8_t dev_addr, uint8_t instance)
+{
+    guncon2h_interface_t *gc_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(gc_itf);
 
-    return 0xff;
+    uint8_t const ep_in = gc_itf->base.ep_in;
+    return !usbh_edpt_busy(dev_addr, ep_in);
 }
 
-static uint8_t get_instance_id_by_itfnum(uint8_t dev_addr, uint8_t itf)
+#if CFG_TUH_GUNCON2_FILTER
+#define FILTER_POS_MAX ((int32_t)UINT16_MAX << 6)
+
+// One alpha-beta step for one axis, all in 1/64 units, no division
+static uint16_t filter_axis(guncon2h_interface_t *gc_itf, uint8_t axis, uint16_t sample)
 {
-    for (uint8_t inst = 0; inst < CFG_TUH_GUNCON2; inst++)
+    int32_t pos = gc_itf->filter_pos[axis];
+    int32_t vel = gc_itf->filter_vel[axis];
+
+    int32_t const pred = TU_MAX(TU_MIN(pos + vel, FILTER_POS_MAX), 0);
+    int32_t const residual = ((int32_t)sample << 6) - pred;
+
+    pos = pred + ((residual * gc_itf->filter.alpha) >> 8);
+    vel = vel + ((residual * gc_itf->filter.beta) >> 8);
+
+    gc_itf->filter_pos[axis] = pos = TU_MAX(TU_MIN(pos, FILTER_POS_MAX), 0);
+    gc_itf->filter_vel[axis] = vel = TU_MAX(TU_MIN(vel, FILTER_POS_MAX), -FILTER_POS_MAX);
+
+    // extrapolate to hide display lag
+    int32_t out = pos + (int32_t)(((int64_t)vel * gc_itf->filter_predict) >> 8);
+    out = TU_MAX(TU_MIN(out, FILTER_POS_MAX), 0);
+
+    return (uint16_t)((out + 32) >> 6);
+}
+
+static void filter_pad(guncon2h_interface_t *gc_itf, guncon2_gamepad_t *pad)
+{
+    // off screen samples are not fed to the filter, it restarts from the
+    // first sample back on screen
+    if (pad->bFlags & GUNCON2_FLAG_OFFSCREEN)
     {
-        guncon2h_interface_t *hid = get_instance(dev_addr, inst);
+        gc_itf->filter_valid = false;
+        return;
+    }
 
-        if ((hid->itf_num == itf) && (hid->ep_in || hid->ep_out))
-            return inst;
+    if (!gc_itf->filter_valid)
+    {
+        gc_itf->filter_pos[0] = (int32_t)pad->wGunX << 6;
+        gc_itf->filter_pos[1] = (int32_t)pad->wGunY << 6;
+        gc_itf->filter_vel[0] = 0;
+        gc_itf->filter_vel[1] = 0;
+        gc_itf->filter_valid = true;
+        return;
     }
 
-    return 0xff;
+    pad->wGunX = filter_axis(gc_itf, 0, pad->wGunX);
+    pad->wGunY = filter_axis(gc_itf, 1, pad->wGunY);
 }
 
-bool tuh_guncon2_n_ready(uint8_t dev_addr, uint8_t instance)
+bool tuh_guncon2_set_filter(uint8_t dev_addr, uint8_t instance, guncon2_filter_config_t const *filter)
+{
+    guncon2h_interface_t *gc_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(gc_itf);
+    // larger gains overshoot, and residual * gain would overflow in filter_axis
+    TU_VERIFY(filter->alpha <= 256 && filter->beta <= 256);
+
+    gc_itf->filter = *filter;
+    gc_itf->filter_predict = (int32_t)(((uint64_t)filter->predict_us << 8) / CFG_TUH_GUNCON2_FRAME_US);
+    gc_itf->filter_valid = false;
+    return true;
+}
+#endif
+
+#if CFG_TUH_GUNCON2_SHOT_QUEUE
+static void shot_push(uint8_t dev_addr, uint8_t instance, uint32_t timestamp_us, guncon2_point_t const *point, uint8_t flags)
 {
     guncon2h_interface_t *gc_itf = get_instance(dev_addr, instance);
-    uint8_t const ep_in = gc_itf->ep_in;
-    return !usbh_edpt_busy(dev_addr, ep_in);
+
+    guncon2_shot_t shot;
+    shot.timestamp_us = timestamp_us;
+    shot.x = point ? point->x : 0;
+    shot.y = point ? point->y : 0;
+    shot.flags = flags;
+
+    // a full queue drops the new shot, the seq gap tells the consumer
+    int32_t const slot = vendorh_ring_reserve(&gc_itf->shot_idx, CFG_TUH_GUNCON2_SHOT_QUEUE, &shot.seq);
+    if (slot >= 0)
+    {
+        gc_itf->shots[slot] = shot;
+        vendorh_ring_publish(&gc_itf->shot_idx);
+    }
+
+    if (tuh_guncon2_shot_cb)
+    {
+        tuh_guncon2_shot_cb(dev_addr, instance, &shot);
+    }
 }
 
-bool tuh_guncon2_receive_report(uint8_t dev_addr, uint8_t instance)
+// Pick the coordinates of a trigger press: the report with the press if it
+// is on screen, else the one before it, else the next on-screen report
+static void shot_latch(uint8_t dev_addr, uint8_t instance, guncon2_point_t const *point, bool onscreen, uint32_t timestamp_us)
 {
     guncon2h_interface_t *gc_itf = get_instance(dev_addr, instance);
-    TU_VERIFY(usbh_edpt_claim(dev_addr, gc_itf->ep_in));
 
-    if ( !usbh_edpt_xfer(dev_addr, gc_itf->ep_in, gc_itf->epin_buf, gc_itf->epin_size) )
+    if (gc_itf->delta.pressed & GUNCON2_GAMEPAD_TRIGGER)
     {
-        usbh_edpt_claim(dev_addr, gc_itf->ep_in);
-        return false;
+        if (gc_itf->shot_wait)
+        {
+            shot_push(dev_addr, instance, gc_itf->shot_time_us, NULL, GUNCON2_SHOT_MISSED);
+            gc_itf->shot_wait = 0;
+        }
+
+        if (onscreen)
+        {
+            shot_push(dev_addr, instance, timestamp_us, point, 0);
+        }
+        else if (gc_itf->shot_last_valid)
+        {
+            shot_push(dev_addr, instance, timestamp_us, &gc_itf->shot_last, GUNCON2_SHOT_PREVIOUS);
+        }
+        else
+        {
+            gc_itf->shot_wait = CFG_TUH_GUNCON2_SHOT_WAIT;
+            gc_itf->shot_time_us = timestamp_us;
+        }
+    }
+    else if (gc_itf->shot_wait)
+    {
+        if (onscreen)
+        {
+            shot_push(dev_addr, instance, gc_itf->shot_time_us, point, GUNCON2_SHOT_LATE);
+            gc_itf->shot_wait = 0;
+        }
+        else if (--gc_itf->shot_wait == 0)
+        {
+            shot_push(dev_addr, instance, gc_itf->shot_time_us, NULL, GUNCON2_SHOT_MISSED);
+        }
     }
+
+    gc_itf->shot_last = *point;
+    gc_itf->shot_last_valid = onscreen;
+}
+
+bool tuh_guncon2_shot_pop(uint8_t dev_addr, uint8_t instance, guncon2_shot_t *shot)
+{
+    guncon2h_interface_t *gc_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(gc_itf);
+
+    int32_t const slot = vendorh_ring_peek(&gc_itf->shot_idx, CFG_TUH_GUNCON2_SHOT_QUEUE);
+    if (slot < 0)
+        return false;
+
+    *shot = gc_itf->shots[slot];
+    vendorh_ring_consume(&gc_itf->shot_idx);
     return true;
 }
+#endif
 
 bool tuh_guncon2_set_60hz(uint8_t dev_addr, uint8_t instance, bool state)
 {
     return tuh_guncon2_send_report(dev_addr, instance, 5, state);
 }
 
-bool tuh_guncon2_send_report(uint8_t dev_addr, uint8_t instance, uint8_t index, bool state)
+// Send the newest pending report. If EP0 is busy it stays pending and is
+// retried on the next command or IN report.
+static void cmd_send_next(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf)
 {
-    uint8_t txbuf[6] = {
-        0, //x offset
-        0, //x offset (0xFF if negative)
-        0, //y offset
-        0, //y offset (0xFF if negative)
-        0, //?
-        0 // mode (1: 60hz)
-    };
-    uint16_t len = sizeof(txbuf);
-    
-    if (index >= len)
-        return false;
-    
-    txbuf[index] = state;
+    guncon2h_interface_t *gc_itf = (guncon2h_interface_t *)itf;
+
+    if (itf->ctrl_inflight || !gc_itf->cmd_pending)
+        return;
+
+    memcpy(gc_itf->cmd_buf, gc_itf->cmd_report, sizeof(gc_itf->cmd_buf));
 
     tusb_control_request_t const request = {
         .bmRequestType_bit = {
@@ -102,164 +233,389 @@ bool tuh_guncon2_send_report(uint8_t dev_addr, uint8_t instance, uint8_t index,
         .bRequest = HID_REQ_CONTROL_SET_REPORT, // ??? HID_REQ_CONTROL_SET_REPORT   = 0x09, ///< Set Report ???
         .wValue   = tu_htole16(TU_U16(2, 0)), //0x0200, tu_htole16(TU_U16(desc_type, index))
         .wIndex   = 0,
-        .wLength  = len
-    };
-    tuh_xfer_t xfer = {
-        .daddr       = dev_addr, // from mount callback
-        .ep_addr     = 0, // control endpoint has address 0
-        .setup       = &request,
-        .buffer      = txbuf,
-        //.complete_cb = complete_cb
+        .wLength  = sizeof(gc_itf->cmd_buf)
     };
 
-    return tuh_control_xfer(&xfer);
+    if (vendorh_ctrl_send(&guncon2_class, dev_addr, instance, &request, gc_itf->cmd_buf))
+    {
+        gc_itf->cmd_pending = false;
+    }
 }
 
-//--------------------------------------------------------------------+
-// USBH API
-//--------------------------------------------------------------------+
+// Queue the instance config report, a newer one replaces one still waiting for EP0
+static bool config_send(uint8_t dev_addr, uint8_t instance)
+{
+    guncon2h_interface_t *gc_itf = get_instance(dev_addr, instance);
 
-void guncon2h_init(void)
+#if CFG_TUH_GUNCON2_STATS
+    if (gc_itf->cmd_pending)
+        gc_itf->stats.out_coalesced++;
+#endif
+
+    gc_itf->cmd_pending = true;
+    cmd_send_next(dev_addr, instance, &gc_itf->base);
+    return true;
+}
+
+bool tuh_guncon2_send_report(uint8_t dev_addr, uint8_t instance, uint8_t index, bool state)
 {
-    tu_memclr(_guncon2h_dev, sizeof(_guncon2h_dev));
+    guncon2h_interface_t *gc_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(gc_itf);
+
+    // cmd_report = {
+    //     x offset (low byte)
+    //     x offset (high byte, 0xFF if negative)
+    //     y offset (low byte)
+    //     y offset (high byte, 0xFF if negative)
+    //     ?
+    //     mode (1: 60hz)
+    // };
+    if (index >= sizeof(gc_itf->cmd_report))
+        return false;
+
+    // only this byte changes, the rest of the config is kept
+    gc_itf->cmd_report[index] = state;
+
+    return config_send(dev_addr, instance);
 }
 
-bool guncon2h_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *desc_itf, uint16_t max_len)
+bool tuh_guncon2_set_config(uint8_t dev_addr, uint8_t instance, guncon2_config_t const *config)
 {
-    TU_VERIFY(dev_addr <= CFG_TUH_DEVICE_MAX);
+    guncon2h_interface_t *gc_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(gc_itf);
 
-    uint16_t PID, VID;
-    tuh_vid_pid_get(dev_addr, &VID, &PID);
+    uint8_t *report = gc_itf->cmd_report;
+    report[0] = (uint8_t)((uint16_t)config->x_offset & 0xFF);
+    report[1] = (uint8_t)((uint16_t)config->x_offset >> 8);
+    report[2] = (uint8_t)((uint16_t)config->y_offset & 0xFF);
+    report[3] = (uint8_t)((uint16_t)config->y_offset >> 8);
+    report[5] = config->mode_60hz;
 
-    if (VID != 0x0B9A && PID != 0x016A)
-    {
-        TU_LOG2("GUNCON2: not a guncon device\n");
-        return false;
-    }
+    return config_send(dev_addr, instance);
+}
 
-    TU_LOG2("GUNCON2 opening Interface %u (addr = %u)\r\n", desc_itf->bInterfaceNumber, dev_addr);
+bool tuh_guncon2_get_config(uint8_t dev_addr, uint8_t instance, guncon2_config_t *config)
+{
+    guncon2h_interface_t *gc_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(gc_itf);
 
-    guncon2h_device_t *guncon2_dev = get_dev(dev_addr);
-    TU_ASSERT(guncon2_dev->inst_count < CFG_TUH_GUNCON2, 0);
+    uint8_t const *report = gc_itf->cmd_report;
+    config->x_offset  = (int16_t)(report[1] << 8 | report[0]);
+    config->y_offset  = (int16_t)(report[3] << 8 | report[2]);
+    config->mode_60hz = report[5];
+    return true;
+}
 
-    guncon2h_interface_t *gc_itf = get_instance(dev_addr, guncon2_dev->inst_count);
-    gc_itf->itf_num = desc_itf->bInterfaceNumber;
+bool tuh_guncon2_calibration_offsets(guncon2_point_t const *samples, guncon2_point_t const *targets, uint8_t count,
+                                     int16_t *x_offset, int16_t *y_offset)
+{
+    TU_VERIFY(count);
 
-    //Parse descriptor for all endpoints and open them
-    uint8_t const *p_desc = (uint8_t const *)desc_itf;
-    int endpoint = 0;
-    int pos = 0;
-    while (endpoint < desc_itf->bNumEndpoints && pos < max_len)
+    int32_t dx = 0;
+    int32_t dy = 0;
+    for (uint8_t i = 0; i < count; i++)
     {
-        if (tu_desc_type(p_desc) != TUSB_DESC_ENDPOINT)
-        {
-            pos += tu_desc_len(p_desc);
-            p_desc = tu_desc_next(p_desc);
-            continue;
-        }
-        tusb_desc_endpoint_t const *desc_ep = (tusb_desc_endpoint_t const *)p_desc;
-        TU_ASSERT(TUSB_DESC_ENDPOINT == desc_ep->bDescriptorType);
-        TU_ASSERT(tuh_edpt_open(dev_addr, desc_ep));
-        if (tu_edpt_dir(desc_ep->bEndpointAddress) == TUSB_DIR_OUT)
-        {
-            gc_itf->ep_out = desc_ep->bEndpointAddress;
-            gc_itf->epout_size = tu_edpt_packet_size(desc_ep);
-        }
-        else
-        {
-            gc_itf->ep_in = desc_ep->bEndpointAddress;
-            gc_itf->epin_size = tu_edpt_packet_size(desc_ep);
-        }
-        endpoint++;
-        pos += tu_desc_len(p_desc);
-        p_desc = tu_desc_next(p_desc);
+        dx += (int32_t)targets[i].x - samples[i].x;
+        dy += (int32_t)targets[i].y - samples[i].y;
     }
 
-    guncon2_dev->inst_count++;
+    // rounded average
+    dx = (dx + (dx < 0 ? -(count / 2) : count / 2)) / count;
+    dy = (dy + (dy < 0 ? -(count / 2) : count / 2)) / count;
+
+    *x_offset = (int16_t)TU_MAX(TU_MIN(dx, INT16_MAX), INT16_MIN);
+    *y_offset = (int16_t)TU_MAX(TU_MIN(dy, INT16_MAX), INT16_MIN);
     return true;
 }
 
-bool guncon2h_set_config(uint8_t dev_addr, uint8_t itf_num)
+bool tuh_guncon2_calibrate(uint8_t dev_addr, uint8_t instance, guncon2_point_t const *samples, guncon2_point_t const *targets, uint8_t count)
 {
-    uint8_t instance = get_instance_id_by_itfnum(dev_addr, itf_num);
-    guncon2h_interface_t *gc_itf = get_instance(dev_addr, instance);
-    gc_itf->connected = true;
+    guncon2_config_t config;
+    int16_t dx, dy;
+
+    TU_VERIFY(tuh_guncon2_get_config(dev_addr, instance, &config));
+    TU_VERIFY(tuh_guncon2_calibration_offsets(samples, targets, count, &dx, &dy));
+
+    // samples were taken with the current offsets applied
+    config.x_offset = (int16_t)TU_MAX(TU_MIN(config.x_offset + dx, INT16_MAX), INT16_MIN);
+    config.y_offset = (int16_t)TU_MAX(TU_MIN(config.y_offset + dy, INT16_MAX), INT16_MIN);
+
+    return tuh_guncon2_set_config(dev_addr, instance, &config);
+}
+
+//--------------------------------------------------------------------+
+// Class hooks
+//--------------------------------------------------------------------+
+
+static uint8_t guncon2_match(uint16_t vid, uint16_t pid, tusb_desc_interface_t const *desc_itf)
+{
+    (void)desc_itf;
+    return (vid != 0x0B9A && pid != 0x016A) ? VENDORH_NO_MATCH : 0;
+}
+
+static void guncon2_mount(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf)
+{
+#if CFG_TUH_GUNCON2_FILTER
+    guncon2_filter_config_t const filter = {
+        .alpha      = CFG_TUH_GUNCON2_FILTER_ALPHA,
+        .beta       = CFG_TUH_GUNCON2_FILTER_BETA,
+        .predict_us = CFG_TUH_GUNCON2_FILTER_PREDICT_US
+    };
+    tuh_guncon2_set_filter(dev_addr, instance, &filter);
+#endif
 
     //set 60hz mode
     tuh_guncon2_set_60hz(dev_addr, instance, true);
 
     if (tuh_guncon2_mount_cb)
     {
-        tuh_guncon2_mount_cb(dev_addr, instance, gc_itf);
+        tuh_guncon2_mount_cb(dev_addr, instance, (guncon2h_interface_t *)itf);
     }
-
-    usbh_driver_set_config_complete(dev_addr, gc_itf->itf_num);
-    return true;
 }
 
-bool guncon2h_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+static void guncon2_umount(uint8_t dev_addr, uint8_t instance)
 {
-    if (result != XFER_RESULT_SUCCESS)
+    if (tuh_guncon2_umount_cb)
     {
-        TU_LOG1("Error: %d\n", result);
-        return false;
+        tuh_guncon2_umount_cb(dev_addr, instance);
     }
+}
 
-    uint8_t const dir = tu_edpt_dir(ep_addr);
-    uint8_t const instance = get_instance_id_by_epaddr(dev_addr, ep_addr);
-    guncon2h_interface_t *gc_itf = get_instance(dev_addr, instance);
-    guncon2_gamepad_t *pad = &gc_itf->pad;
-    uint8_t *rdata = gc_itf->epin_buf;
+static bool guncon2_decode(vendorh_itf_t *itf, uint8_t const *rdata, uint32_t len, void *out)
+{
+    guncon2_gamepad_t *pad = (guncon2_gamepad_t *)out;
+
+    if (len != 6) // data is not valid
+        return false;
+
+    vendorh_decode_fields(guncon2_fields, TU_ARRAY_SIZE(guncon2_fields), rdata, pad);
 
-    if (dir == TUSB_DIR_IN)
+    pad->bFlags = 0;
+    if (pad->wGunX < CFG_TUH_GUNCON2_X_MIN || pad->wGunX > CFG_TUH_GUNCON2_X_MAX ||
+        pad->wGunY < CFG_TUH_GUNCON2_Y_MIN || pad->wGunY > CFG_TUH_GUNCON2_Y_MAX)
     {
-        TU_LOG2("Get Report callback (%u, %u, %u bytes)\r\n", dev_addr, instance, xferred_bytes);
-        TU_LOG2_MEM(gc_itf->epin_buf, xferred_bytes, 2);
-        if (xferred_bytes == 6) // data is valid
-        {
-            tu_memclr(pad, sizeof(guncon2_gamepad_t));
+        pad->bFlags |= GUNCON2_FLAG_OFFSCREEN;
+    }
+
+#if CFG_TUH_GUNCON2_SHOT_QUEUE
+    // shots use the coordinates before filtering
+    guncon2h_interface_t *gc_itf = (guncon2h_interface_t *)itf;
+    gc_itf->shot_raw.x = pad->wGunX;
+    gc_itf->shot_raw.y = pad->wGunY;
+#endif
+
+#if CFG_TUH_GUNCON2_FILTER
+    filter_pad((guncon2h_interface_t *)itf, pad);
+#endif
+    (void)itf;
+    return true;
+}
 
-            pad->bButtons = ((~rdata[1] >> 2) & 0x38) | ((~rdata[0] >> 1) & 0x07);
-            pad->bDpad    = (~rdata[0] >> 4) & 0xF;
+static bool guncon2_diff(void const *prev_pad, void const *new_pad, void *out)
+{
+    guncon2_gamepad_t const *prev = (guncon2_gamepad_t const *)prev_pad;
+    guncon2_gamepad_t const *pad = (guncon2_gamepad_t const *)new_pad;
+    guncon2_gamepad_delta_t *delta = (guncon2_gamepad_delta_t *)out;
+
+    delta->changed = 0;
+    if (pad->bButtons != prev->bButtons) delta->changed |= GUNCON2_FIELD_BUTTONS;
+    if (pad->bDpad    != prev->bDpad)    delta->changed |= GUNCON2_FIELD_DPAD;
+    if (pad->wGunX    != prev->wGunX)    delta->changed |= GUNCON2_FIELD_GUN_X;
+    if (pad->wGunY    != prev->wGunY)    delta->changed |= GUNCON2_FIELD_GUN_Y;
+    if (pad->bFlags   != prev->bFlags)   delta->changed |= GUNCON2_FIELD_FLAGS;
+
+    if (!delta->changed)
+        return false;
 
-            pad->wGunX = rdata[3];
-            pad->wGunX <<= 8;
-            pad->wGunX |= rdata[2];
+    uint16_t const buttons = (uint16_t)(pad->bDpad << 8 | pad->bButtons);
+    uint16_t const prev_buttons = (uint16_t)(prev->bDpad << 8 | prev->bButtons);
+    delta->pressed  = buttons & ~prev_buttons;
+    delta->released = prev_buttons & ~buttons;
+    return true;
+}
 
-            pad->wGunY = rdata[5];
-            pad->wGunY <<= 8;
-            pad->wGunY |= rdata[4];
+#if CFG_TUH_GUNCON2_SHOT_QUEUE
+static void guncon2_decoded(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf)
+{
+    guncon2h_interface_t *gc_itf = (guncon2h_interface_t *)itf;
+    bool const onscreen = !(gc_itf->pad.bFlags & GUNCON2_FLAG_OFFSCREEN);
 
-            gc_itf->new_pad_data = true;
-        }
+    shot_latch(dev_addr, instance, &gc_itf->shot_raw, onscreen, itf->report_time.time_us);
+}
+#endif
+
+static void guncon2_notify(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf, uint8_t const *report, uint16_t len)
+{
+    guncon2h_interface_t *gc_itf = (guncon2h_interface_t *)itf;
+
+    if (itf->new_pad_data && tuh_guncon2_pad_received_cb)
+    {
+        tuh_guncon2_pad_received_cb(dev_addr, instance, &gc_itf->pad, &gc_itf->delta, report, len);
+    }
+    if (tuh_guncon2_report_received_cb)
+    {
         tuh_guncon2_report_received_cb(dev_addr, instance, (const uint8_t *)gc_itf, sizeof(guncon2h_interface_t));
-        gc_itf->new_pad_data = false;
     }
-    else
+}
+
+// Raw reports from tuh_guncon2_send_report on the OUT endpoint and config
+// reports on EP0 both end up in tuh_guncon2_report_sent_cb or report_failed_cb
+static void guncon2_sent(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf, xfer_result_t result, uint8_t const *buf, uint16_t len)
+{
+    (void)itf;
+    if (result == XFER_RESULT_SUCCESS)
     {
         if (tuh_guncon2_report_sent_cb)
-        {
-            tuh_guncon2_report_sent_cb(dev_addr, instance, gc_itf->epout_buf, xferred_bytes);
-        }
+            tuh_guncon2_report_sent_cb(dev_addr, instance, buf, len);
+    }
+    else if (tuh_guncon2_report_failed_cb)
+    {
+        tuh_guncon2_report_failed_cb(dev_addr, instance, buf, len, result);
     }
+}
 
-    return true;
+static vendorh_class_t const guncon2_class =
+{
+    .id              = VENDORH_CLASS_GUNCON2,
+    .itf_max         = CFG_TUH_GUNCON2,
+    .flags           = CFG_TUH_GUNCON2_REPORT_ON_CHANGE ? VENDORH_CLASS_REPORT_ON_CHANGE : 0,
+    .name            = "GUNCON2",
+    .devs            = _guncon2h_dev,
+    .dev_size        = sizeof(guncon2h_device_t),
+    .itf_offset      = offsetof(guncon2h_device_t, instances),
+    .itf_size        = sizeof(guncon2h_interface_t),
+    .pad_offset      = offsetof(guncon2h_interface_t, pad),
+    .delta_offset    = offsetof(guncon2h_interface_t, delta),
+    .pad_size        = sizeof(guncon2_gamepad_t),
+    .delta_size      = sizeof(guncon2_gamepad_delta_t),
+    .epin_offset     = offsetof(guncon2h_interface_t, epin_buf),
+    .epin_bufsize    = CFG_TUH_GUNCON2_EPIN_BUFSIZE,
+    .epout_offset    = offsetof(guncon2h_interface_t, epout_buf),
+    .epout_bufsize   = CFG_TUH_GUNCON2_EPOUT_BUFSIZE,
+#if CFG_TUH_GUNCON2_STATS
+    .stats_offset    = offsetof(guncon2h_interface_t, stats),
+#endif
+#if CFG_TUH_GUNCON2_RECOVERY
+    .recovery_offset = offsetof(guncon2h_interface_t, recovery),
+#endif
+#if CFG_TUH_GUNCON2_RING_SIZE
+    .ring_idx_offset = offsetof(guncon2h_interface_t, ring_idx),
+    .ring_offset     = offsetof(guncon2h_interface_t, ring),
+    .ring_entry_size = sizeof(guncon2_gamepad_entry_t),
+    .ring_depth      = CFG_TUH_GUNCON2_RING_SIZE,
+    .ring_entry_pad  = offsetof(guncon2_gamepad_entry_t, pad),
+#endif
+    .match           = guncon2_match,
+    .mount           = guncon2_mount,
+    .umount          = guncon2_umount,
+    .decode          = guncon2_decode,
+    .diff            = guncon2_diff,
+#if CFG_TUH_GUNCON2_SHOT_QUEUE
+    .decoded         = guncon2_decoded,
+#endif
+    .notify          = guncon2_notify,
+    .out_done        = guncon2_sent,
+    .ctrl_done       = guncon2_sent,
+    .flush           = cmd_send_next,
+    .time_us         = tuh_guncon2_time_us_cb,
+    .link            = tuh_guncon2_link_cb,
+};
+
+//--------------------------------------------------------------------+
+// Interface API
+//--------------------------------------------------------------------+
+
+bool tuh_guncon2_get_state(uint8_t dev_addr, uint8_t instance, guncon2_gamepad_t *pad)
+{
+    return vendorh_get_pad(&guncon2_class, dev_addr, instance, pad);
 }
 
-void guncon2h_close(uint8_t dev_addr)
+bool tuh_guncon2_get_report_time(uint8_t dev_addr, uint8_t instance, vendorh_report_time_t *report_time)
 {
-    TU_VERIFY(dev_addr <= CFG_TUH_DEVICE_MAX, );
-    guncon2h_device_t *guncon2_dev = get_dev(dev_addr);
+    return vendorh_get_report_time(&guncon2_class, dev_addr, instance, report_time);
+}
 
-    for (uint8_t inst = 0; inst < guncon2_dev->inst_count; inst++)
-    {
-        if (tuh_guncon2_umount_cb)
-        {
-            tuh_guncon2_umount_cb(dev_addr, inst);
-        }
-    }
-    tu_memclr(guncon2_dev, sizeof(guncon2h_device_t));
+#if CFG_TUH_GUNCON2_STATS
+bool tuh_guncon2_get_stats(uint8_t dev_addr, uint8_t instance, vendorh_stats_t *stats)
+{
+    return vendorh_get_stats(&guncon2_class, dev_addr, instance, stats);
 }
 
+void tuh_guncon2_reset_stats(uint8_t dev_addr, uint8_t instance)
+{
+    vendorh_reset_stats(&guncon2_class, dev_addr, instance);
+}
+#endif
+
+bool tuh_guncon2_receive_report(uint8_t dev_addr, uint8_t instance)
+{
+    return vendorh_receive_report(&guncon2_class, dev_addr, instance);
+}
+
+#if CFG_TUH_GUNCON2_AUTO_POLL
+bool tuh_guncon2_start_polling(uint8_t dev_addr, uint8_t instance)
+{
+    return vendorh_start_polling(&guncon2_class, dev_addr, instance);
+}
+
+void tuh_guncon2_stop_polling(uint8_t dev_addr, uint8_t instance)
+{
+    vendorh_stop_polling(&guncon2_class, dev_addr, instance);
+}
+
+bool tuh_guncon2_is_polling(uint8_t dev_addr, uint8_t instance)
+{
+    return vendorh_is_polling(&guncon2_class, dev_addr, instance);
+}
+#endif
+
+#if CFG_TUH_GUNCON2_RING_SIZE
+bool tuh_guncon2_ring_pop(uint8_t dev_addr, uint8_t instance, guncon2_gamepad_entry_t *entry)
+{
+    return vendorh_ring_pop(&guncon2_class, dev_addr, instance, entry);
+}
+#endif
+
+void tuh_guncon2_task(uint32_t now_ms)
+{
+    vendorh_task(&guncon2_class, now_ms);
+}
+
+#if CFG_TUH_VENDORH_TRACE
+bool tuh_guncon2_replay(uint8_t dev_addr, uint8_t instance, uint8_t ep_addr, xfer_result_t result, uint8_t const *data, uint16_t len)
+{
+    return vendorh_replay(&guncon2_class, dev_addr, instance, ep_addr, result, data, len);
+}
+#endif
+
+//--------------------------------------------------------------------+
+// USBH API
+//--------------------------------------------------------------------+
+
+void guncon2h_init(void)
+{
+    vendorh_init(&guncon2_class);
+}
+
+bool guncon2h_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *desc_itf, uint16_t max_len)
+{
+    (void)rhport;
+    return vendorh_open(&guncon2_class, dev_addr, desc_itf, max_len);
+}
+
+bool guncon2h_set_config(uint8_t dev_addr, uint8_t itf_num)
+{
+    return vendorh_set_config(&guncon2_class, dev_addr, itf_num);
+}
+
+bool guncon2h_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+    return vendorh_xfer_cb(&guncon2_class, dev_addr, ep_addr, result, xferred_bytes);
+}
+
+void guncon2h_close(uint8_t dev_addr)
+{
+    vendorh_close(&guncon2_class, dev_addr);
+}
 
 #endif
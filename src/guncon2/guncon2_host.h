@@ -10,6 +10,8 @@
 #ifndef _TUSB_GUNCON2_HOST_H_
 #define _TUSB_GUNCON2_HOST_H_
 
+#include "../common/vendorh_core.h"
+
 #ifdef __cplusplus
  extern "C" {
 #endif
@@ -26,6 +28,82 @@
 #define CFG_TUH_GUNCON2_EPOUT_BUFSIZE 64
 #endif
 
+// Re-queue the IN transfer from the xfer callback so every bInterval is used
+#ifndef CFG_TUH_GUNCON2_AUTO_POLL
+#define CFG_TUH_GUNCON2_AUTO_POLL 0
+#endif
+
+// Only invoke tuh_guncon2_report_received_cb when the decoded pad changed
+#ifndef CFG_TUH_GUNCON2_REPORT_ON_CHANGE
+#define CFG_TUH_GUNCON2_REPORT_ON_CHANGE 0
+#endif
+
+// Depth of the per-instance ring of decoded pads (power of two, 0 to disable)
+#ifndef CFG_TUH_GUNCON2_RING_SIZE
+#define CFG_TUH_GUNCON2_RING_SIZE 0
+#endif
+
+
+// Per-instance counters and latency histograms, see tuh_guncon2_get_stats
+#ifndef CFG_TUH_GUNCON2_STATS
+#define CFG_TUH_GUNCON2_STATS 0
+#endif
+
+// Clear halts and re-arm failed IN transfers with backoff, driven by tuh_guncon2_task
+#ifndef CFG_TUH_GUNCON2_RECOVERY
+#define CFG_TUH_GUNCON2_RECOVERY 0
+#endif
+
+// Depth of the per-instance queue of latched shots (power of two, 0 to disable)
+#ifndef CFG_TUH_GUNCON2_SHOT_QUEUE
+#define CFG_TUH_GUNCON2_SHOT_QUEUE 0
+#endif
+
+// Reports to wait for an on-screen sample after a trigger press
+#ifndef CFG_TUH_GUNCON2_SHOT_WAIT
+#define CFG_TUH_GUNCON2_SHOT_WAIT 2
+#endif
+
+// Coordinates outside this window are flagged GUNCON2_FLAG_OFFSCREEN
+#ifndef CFG_TUH_GUNCON2_X_MIN
+#define CFG_TUH_GUNCON2_X_MIN 175
+#endif
+
+#ifndef CFG_TUH_GUNCON2_X_MAX
+#define CFG_TUH_GUNCON2_X_MAX 720
+#endif
+
+#ifndef CFG_TUH_GUNCON2_Y_MIN
+#define CFG_TUH_GUNCON2_Y_MIN 20
+#endif
+
+#ifndef CFG_TUH_GUNCON2_Y_MAX
+#define CFG_TUH_GUNCON2_Y_MAX 240
+#endif
+
+// Fixed-point alpha-beta filter and aim prediction on wGunX/wGunY
+#ifndef CFG_TUH_GUNCON2_FILTER
+#define CFG_TUH_GUNCON2_FILTER 0
+#endif
+
+// Default filter gains in 1/256 units, see guncon2_filter_config_t
+#ifndef CFG_TUH_GUNCON2_FILTER_ALPHA
+#define CFG_TUH_GUNCON2_FILTER_ALPHA 128
+#endif
+
+#ifndef CFG_TUH_GUNCON2_FILTER_BETA
+#define CFG_TUH_GUNCON2_FILTER_BETA 32
+#endif
+
+#ifndef CFG_TUH_GUNCON2_FILTER_PREDICT_US
+#define CFG_TUH_GUNCON2_FILTER_PREDICT_US 0
+#endif
+
+// Time between two reports, one video frame
+#ifndef CFG_TUH_GUNCON2_FRAME_US
+#define CFG_TUH_GUNCON2_FRAME_US 16667
+#endif
+
 #define GUNCON2_GAMEPAD_DPAD_UP    0x01
 #define GUNCON2_GAMEPAD_DPAD_DOWN  0x02
 #define GUNCON2_GAMEPAD_DPAD_LEFT  0x04
@@ -38,6 +116,12 @@
 #define GUNCON2_GAMEPAD_SELECT  0x10
 #define GUNCON2_GAMEPAD_START   0x20
 
+#define GUNCON2_FLAG_OFFSCREEN 0x01
+
+#define GUNCON2_SHOT_PREVIOUS 0x01 // coordinates from the report before the trigger press
+#define GUNCON2_SHOT_LATE     0x02 // coordinates from a report after the trigger press
+#define GUNCON2_SHOT_MISSED   0x04 // no on-screen report around the press, x and y are 0
+
 #define MAX_PACKET_SIZE 32
 
 typedef struct guncon2_gamepad
@@ -46,41 +130,190 @@ typedef struct guncon2_gamepad
     uint8_t bDpad;
     uint16_t wGunX;
     uint16_t wGunY;
+    uint8_t bFlags;
 } guncon2_gamepad_t;
 
+// Feature report kept per instance and sent as a whole.
+// The gun adds the offsets to the coordinates it reports.
+typedef struct
+{
+    int16_t x_offset;
+    int16_t y_offset;
+    bool mode_60hz;
+} guncon2_config_t;
+
+typedef struct
+{
+    uint16_t x;
+    uint16_t y;
+} guncon2_point_t;
+
+// alpha 256, beta 0 and predict_us 0 pass the coordinates through
+typedef struct
+{
+    uint16_t alpha;      // position gain, 1/256 units, at most 256
+    uint16_t beta;       // velocity gain, 1/256 units, at most 256
+    uint32_t predict_us; // how far ahead the aim point is extrapolated
+} guncon2_filter_config_t;
+
+// guncon2_gamepad_delta_t::changed bits
+#define GUNCON2_FIELD_BUTTONS 0x01
+#define GUNCON2_FIELD_DPAD    0x02
+#define GUNCON2_FIELD_GUN_X   0x04
+#define GUNCON2_FIELD_GUN_Y   0x08
+#define GUNCON2_FIELD_FLAGS   0x10
+
 typedef struct
 {
+    uint8_t changed;   // GUNCON2_FIELD_* that differ from the previous pad
+    uint16_t pressed;  // bButtons (low byte) and bDpad (high byte) bits that went from 0 to 1
+    uint16_t released; // bButtons (low byte) and bDpad (high byte) bits that went from 1 to 0
+} guncon2_gamepad_delta_t;
+
+typedef struct
+{
+    uint32_t timestamp_us; // from tuh_guncon2_time_us_cb
+    uint32_t frame;        // host SOF frame number
+    uint32_t seq;          // increments on every decoded report, gaps mean dropped entries
     guncon2_gamepad_t pad;
-    uint8_t connected;
-    uint8_t new_pad_data;
-    uint8_t itf_num;
-    uint8_t ep_in;
-    uint8_t ep_out;
+} guncon2_gamepad_entry_t;
 
-    uint16_t epin_size;
-    uint16_t epout_size;
+typedef struct
+{
+    uint32_t timestamp_us; // report with the trigger press, from tuh_guncon2_time_us_cb
+    uint32_t seq;          // increments on every shot, gaps mean dropped shots
+    uint16_t x;            // raw (unfiltered) coordinates
+    uint16_t y;
+    uint8_t flags;         // GUNCON2_SHOT_*
+} guncon2_shot_t;
 
-    uint8_t epin_buf[CFG_TUH_GUNCON2_EPIN_BUFSIZE];
+typedef struct
+{
+    vendorh_itf_t base; // connection, endpoints and pad_seq, see vendorh_core.h
+    guncon2_gamepad_t pad;
+    guncon2_gamepad_delta_t delta; // pad changes made by the last report
+
+    // IN transfers alternate between the two buffers so the next one
+    // can be queued while the previous report is still being decoded
+    uint8_t epin_buf[2][CFG_TUH_GUNCON2_EPIN_BUFSIZE];
     uint8_t epout_buf[CFG_TUH_GUNCON2_EPOUT_BUFSIZE];
+
+    // feature report sent on EP0, newest report wins
+    uint8_t cmd_buf[6];      // report being sent
+    uint8_t cmd_report[6];   // newest config report, see guncon2_config_t
+    uint8_t cmd_pending;
+
+#if CFG_TUH_GUNCON2_FILTER
+    guncon2_filter_config_t filter;
+    int32_t filter_pos[2];   // x, y in 1/64 units
+    int32_t filter_vel[2];   // x, y in 1/64 units per report
+    int32_t filter_predict;  // predict_us in reports, 1/256 units
+    uint8_t filter_valid;    // reset after the gun left the screen
+#endif
+
+#if CFG_TUH_GUNCON2_RING_SIZE
+    // single producer (USB task) / single consumer ring
+    vendorh_ring_t ring_idx;
+    guncon2_gamepad_entry_t ring[CFG_TUH_GUNCON2_RING_SIZE];
+#endif
+
+#if CFG_TUH_GUNCON2_STATS
+    vendorh_stats_t stats;
+#endif
+
+#if CFG_TUH_GUNCON2_RECOVERY
+    vendorh_recovery_t recovery;
+#endif
+
+#if CFG_TUH_GUNCON2_SHOT_QUEUE
+    guncon2_point_t shot_raw;   // unfiltered coordinates of the last report
+    guncon2_point_t shot_last;  // previous report, if it was on screen
+    uint8_t shot_last_valid;
+    uint8_t shot_wait;          // reports left to find coordinates for a press
+    uint32_t shot_time_us;      // timestamp of the press being waited on
+    vendorh_ring_t shot_idx;
+    guncon2_shot_t shots[CFG_TUH_GUNCON2_SHOT_QUEUE];
+#endif
 } guncon2h_interface_t;
 
 //--------------------------------------------------------------------+
 // Callbacks
 //--------------------------------------------------------------------+
 
-void tuh_guncon2_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
+// Implement either one (or both) of the report callbacks.
+// pad_received is only invoked for valid reports and gets the decoded pad,
+// what changed since the previous one and the raw report, without copies.
+TU_ATTR_WEAK void tuh_guncon2_pad_received_cb(uint8_t dev_addr, uint8_t instance, guncon2_gamepad_t const *pad, guncon2_gamepad_delta_t const *delta, uint8_t const *report, uint16_t len);
+// report points to the whole guncon2h_interface_t
+TU_ATTR_WEAK void tuh_guncon2_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
 TU_ATTR_WEAK void tuh_guncon2_report_sent_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
+// A report could not be sent, EP0 requests after CFG_TUH_VENDORH_CTRL_RETRIES resends
+TU_ATTR_WEAK void tuh_guncon2_report_failed_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len, xfer_result_t result);
 TU_ATTR_WEAK void tuh_guncon2_umount_cb(uint8_t dev_addr, uint8_t instance);
 TU_ATTR_WEAK void tuh_guncon2_mount_cb(uint8_t dev_addr, uint8_t instance, const guncon2h_interface_t *guncon2_itf);
 
+// A trigger press was latched, also queued for tuh_guncon2_shot_pop
+TU_ATTR_WEAK void tuh_guncon2_shot_cb(uint8_t dev_addr, uint8_t instance, guncon2_shot_t const *shot);
+
+// Microsecond clock used to timestamp reports, e.g. time_us_32() on RP2040
+TU_ATTR_WEAK uint32_t tuh_guncon2_time_us_cb(void);
+
+// IN transfers started failing (VENDORH_LINK_DEGRADED) or work again (VENDORH_LINK_UP)
+TU_ATTR_WEAK void tuh_guncon2_link_cb(uint8_t dev_addr, uint8_t instance, vendorh_link_t link);
+
 //--------------------------------------------------------------------+
 // Interface API
 //--------------------------------------------------------------------+
 
 bool tuh_guncon2_n_ready(uint8_t dev_addr, uint8_t instance);
 bool tuh_guncon2_receive_report(uint8_t dev_addr, uint8_t instance);
+// Copy of the latest decoded pad, safe to call from any core or task
+bool tuh_guncon2_get_state(uint8_t dev_addr, uint8_t instance, guncon2_gamepad_t *pad);
+// Arrival time and SOF frame of the report the pad was decoded from
+bool tuh_guncon2_get_report_time(uint8_t dev_addr, uint8_t instance, vendorh_report_time_t *report_time);
+#if CFG_TUH_GUNCON2_STATS
+// Copy of the instance counters, call from the USB host task
+bool tuh_guncon2_get_stats(uint8_t dev_addr, uint8_t instance, vendorh_stats_t *stats);
+void tuh_guncon2_reset_stats(uint8_t dev_addr, uint8_t instance);
+#endif
+#if CFG_TUH_GUNCON2_AUTO_POLL
+bool tuh_guncon2_start_polling(uint8_t dev_addr, uint8_t instance);
+void tuh_guncon2_stop_polling(uint8_t dev_addr, uint8_t instance);
+// False once polling stopped on its own, after a failed re-arm or an IN error without recovery
+bool tuh_guncon2_is_polling(uint8_t dev_addr, uint8_t instance);
+#endif
+#if CFG_TUH_GUNCON2_RING_SIZE
+// Safe to call from another core than the one running the USB host task
+bool tuh_guncon2_ring_pop(uint8_t dev_addr, uint8_t instance, guncon2_gamepad_entry_t *entry);
+#endif
+#if CFG_TUH_GUNCON2_SHOT_QUEUE
+// Oldest latched shot, safe to call from another core than the USB host task
+bool tuh_guncon2_shot_pop(uint8_t dev_addr, uint8_t instance, guncon2_shot_t *shot);
+#endif
+// Reports are sent on EP0 without blocking, tuh_guncon2_report_sent_cb fires
+// when one completes. Only the newest report is sent if EP0 is busy.
 bool tuh_guncon2_send_report(uint8_t dev_addr, uint8_t instance, uint8_t function, bool state);
 bool tuh_guncon2_set_60hz(uint8_t dev_addr, uint8_t instance, bool state);
+#if CFG_TUH_GUNCON2_FILTER
+bool tuh_guncon2_set_filter(uint8_t dev_addr, uint8_t instance, guncon2_filter_config_t const *filter);
+#endif
+bool tuh_guncon2_set_config(uint8_t dev_addr, uint8_t instance, guncon2_config_t const *config);
+bool tuh_guncon2_get_config(uint8_t dev_addr, uint8_t instance, guncon2_config_t *config);
+
+// Offsets that move the aimed samples onto their targets (e.g. the screen
+// corners), averaged over count points
+bool tuh_guncon2_calibration_offsets(guncon2_point_t const *samples, guncon2_point_t const *targets, uint8_t count,
+                                     int16_t *x_offset, int16_t *y_offset);
+// Add the calibration offsets to the current config and send it in one transfer
+bool tuh_guncon2_calibrate(uint8_t dev_addr, uint8_t instance, guncon2_point_t const *samples, guncon2_point_t const *targets, uint8_t count);
+// Call periodically from the main loop with a millisecond clock, in the
+// context that runs tuh_task: it shares driver state with the transfer callbacks
+void tuh_guncon2_task(uint32_t now_ms);
+#if CFG_TUH_VENDORH_TRACE
+// Feed a captured transfer to a mounted instance as if it just completed,
+// e.g. from vendorh_trace_replay in a host test
+bool tuh_guncon2_replay(uint8_t dev_addr, uint8_t instance, uint8_t ep_addr, xfer_result_t result, uint8_t const *data, uint16_t len);
+#endif
 
 //--------------------------------------------------------------------+
 // Internal Class Driver API
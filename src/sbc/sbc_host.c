@@ -6,65 +6,183 @@
 #include "host/usbh_classdriver.h"
 #include "sbc_host.h"
 
+#if CFG_TUH_SBC_RING_SIZE
+TU_VERIFY_STATIC((CFG_TUH_SBC_RING_SIZE & (CFG_TUH_SBC_RING_SIZE - 1)) == 0, "CFG_TUH_SBC_RING_SIZE must be a power of two");
+TU_VERIFY_STATIC(offsetof(sbc_gamepad_entry_t, seq) == 8, "entry layout is not the one vendorh_core fills");
+#endif
+TU_VERIFY_STATIC(sizeof(sbc_gamepad_t) <= VENDORH_PAD_MAX, "pad is too large");
+TU_VERIFY_STATIC(SBC_AXIS_COUNT <= VENDORH_AXIS_MAX, "too many axes");
+
 typedef struct
 {
-    uint8_t inst_count;
+    vendorh_dev_t base;
     sbch_interface_t instances[CFG_TUH_SBC];
 } sbch_device_t;
 
+TU_VERIFY_STATIC(sizeof(sbch_device_t) <= UINT16_MAX, "vendorh_class_t offsets are 16-bit");
+
 static sbch_device_t _sbch_dev[CFG_TUH_DEVICE_MAX];
 
-TU_ATTR_ALWAYS_INLINE static inline sbch_device_t *get_dev(uint8_t dev_addr)
+static vendorh_class_t const sbc_class;
+
+static vendorh_field_t const sbc_fields[] =
 {
-    return &_sbch_dev[dev_addr - 1];
-}
+    VENDORH_FIELD( 2, 0, 0, 0xFF, sbc_gamepad_t, bButtons,        0),
+    VENDORH_FIELD( 3, 0, 0, 0xFF, sbc_gamepad_t, bButtons,        8),
+    VENDORH_FIELD( 4, 0, 0, 0xFF, sbc_gamepad_t, bButtons,       16),
+    VENDORH_FIELD( 5, 0, 0, 0xFF, sbc_gamepad_t, bButtons,       24),
+    VENDORH_FIELD( 6, 0, 0, 0x7F, sbc_gamepad_t, bButtons,       32),
+    VENDORH_FIELD( 9, 0, 0, 0xFF, sbc_gamepad_t, bAimingX,        0),
+    VENDORH_FIELD(11, 0, 0, 0xFF, sbc_gamepad_t, bAimingY,        0),
+    VENDORH_FIELD(13, 0, 0, 0xFF, sbc_gamepad_t, bRotationLever,  0),
+    VENDORH_FIELD(15, 0, 0, 0xFF, sbc_gamepad_t, bSightChangeX,   0),
+    VENDORH_FIELD(17, 0, 0, 0xFF, sbc_gamepad_t, bSightChangeY,   0),
+    VENDORH_FIELD(19, 0, 0, 0xFF, sbc_gamepad_t, bLeftPedal,      0),
+    VENDORH_FIELD(21, 0, 0, 0xFF, sbc_gamepad_t, bMiddlePedal,    0),
+    VENDORH_FIELD(23, 0, 0, 0xFF, sbc_gamepad_t, bRightPedal,     0),
+    VENDORH_FIELD(24, 0, 0, 0x0F, sbc_gamepad_t, bTunerDial,      0),
+    VENDORH_FIELD(25, 0, 0, 0xFF, sbc_gamepad_t, bGearLever,      0),
+};
 
 TU_ATTR_ALWAYS_INLINE static inline sbch_interface_t *get_instance(uint8_t dev_addr, uint8_t instance)
 {
     return &_sbch_dev[dev_addr - 1].instances[instance];
 }
 
-static uint8_t get_instance_id_by_epaddr(uint8_t dev_addr, uint8_t ep_addr)
+// Instance for the public API, NULL if out of range or not connected
+TU_ATTR_ALWAYS_INLINE static inline sbch_interface_t *find_instance(uint8_t dev_addr, uint8_t instance)
 {
-    for (uint8_t inst = 0; inst < CFG_TUH_SBC; inst++)
-    {
-        sbch_interface_t *hid = get_instance(dev_addr, inst);
+    return (sbch_interface_t *)vendorh_find_itf(&sbc_class, dev_addr, instance);
+}
 
-        if ((ep_addr == hid->ep_in) || (ep_addr == hid->ep_out))
-            return inst;
-    }
+#if CFG_TUH_SBC_AXIS_CAL
+// pad member of every sbc_axis_t
+static uint8_t const axis_src[SBC_AXIS_COUNT] =
+{
+    offsetof(sbc_gamepad_t, bAimingX),
+    offsetof(sbc_gamepad_t, bAimingY),
+    offsetof(sbc_gamepad_t, bRotationLever),
+    offsetof(sbc_gamepad_t, bSightChangeX),
+    offsetof(sbc_gamepad_t, bSightChangeY),
+    offsetof(sbc_gamepad_t, bLeftPedal),
+    offsetof(sbc_gamepad_t, bMiddlePedal),
+    offsetof(sbc_gamepad_t, bRightPedal),
+};
+
+#define AXIS_STICK { .min = 0, .center = 128, .max = 255, .flags = VENDORH_AXIS_BIPOLAR }
+#define AXIS_PEDAL { .min = 0, .center = 128, .max = 255, .flags = 0 }
+
+static vendorh_axis_cal_t const axis_default[SBC_AXIS_COUNT] =
+{
+    AXIS_STICK, AXIS_STICK, AXIS_STICK, AXIS_STICK, AXIS_STICK,
+    AXIS_PEDAL, AXIS_PEDAL, AXIS_PEDAL,
+};
+#endif
 
-    return 0xff;
+//--------------------------------------------------------------------+
+// Class hooks
+//--------------------------------------------------------------------+
+
+static uint8_t sbc_match(uint16_t vid, uint16_t pid, tusb_desc_interface_t const *desc_itf)
+{
+    if (vid != 0x0A7B && pid != 0xD000 &&
+        desc_itf->bInterfaceClass != 0x58 &&  //XboxOG bInterfaceClass
+        desc_itf->bInterfaceSubClass != 0x42) //XboxOG bInterfaceSubClass
+    {
+        return VENDORH_NO_MATCH;
+    }
+    return 0;
 }
 
-static uint8_t get_instance_id_by_itfnum(uint8_t dev_addr, uint8_t itf)
+static void sbc_mount(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf)
 {
-    for (uint8_t inst = 0; inst < CFG_TUH_SBC; inst++)
+    if (tuh_sbc_mount_cb)
     {
-        sbch_interface_t *hid = get_instance(dev_addr, inst);
+        tuh_sbc_mount_cb(dev_addr, instance, (sbch_interface_t *)itf);
+    }
+}
 
-        if ((hid->itf_num == itf) && (hid->ep_in || hid->ep_out))
-            return inst;
+static void sbc_umount(uint8_t dev_addr, uint8_t instance)
+{
+    if (tuh_sbc_umount_cb)
+    {
+        tuh_sbc_umount_cb(dev_addr, instance);
     }
+}
 
-    return 0xff;
+static bool sbc_decode(vendorh_itf_t *itf, uint8_t const *rdata, uint32_t len, void *out)
+{
+    (void)itf;
+    sbc_gamepad_t *pad = (sbc_gamepad_t *)out;
+
+    if (len != 26 || (rdata[6] & 0x80) != 0x80 || rdata[7] != 0x00 || (rdata[24] & 0xF0) != 0x00)
+        return false;
+
+    vendorh_decode_fields(sbc_fields, TU_ARRAY_SIZE(sbc_fields), rdata, pad);
+    return true;
 }
 
-bool tuh_sbc_receive_report(uint8_t dev_addr, uint8_t instance)
+static bool sbc_diff(void const *prev_pad, void const *new_pad, void *out)
+{
+    sbc_gamepad_t const *prev = (sbc_gamepad_t const *)prev_pad;
+    sbc_gamepad_t const *pad = (sbc_gamepad_t const *)new_pad;
+    sbc_gamepad_delta_t *delta = (sbc_gamepad_delta_t *)out;
+
+    delta->changed = 0;
+    if (pad->bButtons       != prev->bButtons)       delta->changed |= SBC_FIELD_BUTTONS;
+    if (pad->bRotationLever != prev->bRotationLever) delta->changed |= SBC_FIELD_ROTATION_LEVER;
+    if (pad->bSightChangeX  != prev->bSightChangeX)  delta->changed |= SBC_FIELD_SIGHT_CHANGE_X;
+    if (pad->bSightChangeY  != prev->bSightChangeY)  delta->changed |= SBC_FIELD_SIGHT_CHANGE_Y;
+    if (pad->bAimingX       != prev->bAimingX)       delta->changed |= SBC_FIELD_AIMING_X;
+    if (pad->bAimingY       != prev->bAimingY)       delta->changed |= SBC_FIELD_AIMING_Y;
+    if (pad->bLeftPedal     != prev->bLeftPedal)     delta->changed |= SBC_FIELD_LEFT_PEDAL;
+    if (pad->bMiddlePedal   != prev->bMiddlePedal)   delta->changed |= SBC_FIELD_MIDDLE_PEDAL;
+    if (pad->bRightPedal    != prev->bRightPedal)    delta->changed |= SBC_FIELD_RIGHT_PEDAL;
+    if (pad->bTunerDial     != prev->bTunerDial)     delta->changed |= SBC_FIELD_TUNER_DIAL;
+    if (pad->bGearLever     != prev->bGearLever)     delta->changed |= SBC_FIELD_GEAR_LEVER;
+
+    if (!delta->changed)
+        return false;
+
+    delta->pressed  = pad->bButtons & ~prev->bButtons;
+    delta->released = prev->bButtons & ~pad->bButtons;
+    return true;
+}
+
+static void sbc_notify(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf, uint8_t const *report, uint16_t len)
 {
-    sbch_interface_t *sbc_itf = get_instance(dev_addr, instance);
-    TU_VERIFY(usbh_edpt_claim(dev_addr, sbc_itf->ep_in));
+    sbch_interface_t *sbc_itf = (sbch_interface_t *)itf;
 
-    if ( !usbh_edpt_xfer(dev_addr, sbc_itf->ep_in, sbc_itf->epin_buf, sbc_itf->epin_size) )
+    if (itf->new_pad_data && tuh_sbc_pad_received_cb)
     {
-        usbh_edpt_claim(dev_addr, sbc_itf->ep_in);
-        return false;
+        tuh_sbc_pad_received_cb(dev_addr, instance, &sbc_itf->pad, &sbc_itf->delta, report, len);
+    }
+    if (tuh_sbc_report_received_cb)
+    {
+        tuh_sbc_report_received_cb(dev_addr, instance, (const uint8_t *)sbc_itf, sizeof(sbch_interface_t));
     }
-    return true;
 }
 
-bool tuh_sbc_set_leds(uint8_t dev_addr, uint8_t instance, const sbc_leds_t *value)
+// LED frame with the wanted state if it differs from the last one queued.
+// While the OUT endpoint is busy the state stays pending and is sent from
+// the OUT completion, so only the newest state goes out after a burst of updates.
+static uint16_t leds_build(vendorh_itf_t *itf, uint8_t *txbuf)
 {
+    sbch_interface_t *sbc_itf = (sbch_interface_t *)itf;
+
+    if (!sbc_itf->leds_pending)
+        return 0;
+
+    sbc_itf->leds_pending = false;
+
+    if (sbc_itf->leds_sent_valid && memcmp(&sbc_itf->leds, &sbc_itf->leds_sent, sizeof(sbc_leds_t)) == 0)
+    {
+#if CFG_TUH_SBC_STATS
+        sbc_itf->stats.out_coalesced++;
+#endif
+        return 0;
+    }
+
     // uint8_t txbuf[22] = {
     //     0x00, //Start
     //     0x16, //bLen (22 bytes)
@@ -89,176 +207,264 @@ bool tuh_sbc_set_leds(uint8_t dev_addr, uint8_t instance, const sbc_leds_t *valu
     //     value, //0x0F Gear4 | 0xF0 Gear5
     //     0x00, //Unused?
     // };
-    
-    uint8_t txbuf[22];
+
     txbuf[0] = 0x00;  //Start
     txbuf[1] = 0x16;  //bLen (22 bytes)
     txbuf[21] = 0x00; //Unused?
 
-    memcpy(txbuf + 2, value, sizeof(sbc_leds_t));
-
-    uint16_t len = sizeof(txbuf);
+    memcpy(txbuf + 2, &sbc_itf->leds, sizeof(sbc_leds_t));
 
-    return tuh_sbc_send_report(dev_addr, instance, txbuf, len);
+    sbc_itf->leds_sent = sbc_itf->leds;
+    sbc_itf->leds_sent_valid = true;
+    sbc_itf->leds_inflight = true;
+    return SBC_LEDS_REPORT_SIZE;
 }
 
-bool tuh_sbc_send_report(uint8_t dev_addr, uint8_t instance, const uint8_t *txbuf, uint16_t len)
+static void sbc_out_done(uint8_t dev_addr, uint8_t instance, vendorh_itf_t *itf, xfer_result_t result, uint8_t const *buf, uint16_t len)
 {
-    sbch_interface_t *sbc_itf = get_instance(dev_addr, instance);
+    sbch_interface_t *sbc_itf = (sbch_interface_t *)itf;
+
+    if (result != XFER_RESULT_SUCCESS)
+    {
+        if (sbc_itf->leds_inflight)
+        {
+            // LED state on the device is unknown, send the frame again
+            sbc_itf->leds_inflight = false;
+            sbc_itf->leds_sent_valid = false;
+            sbc_itf->leds_pending = true;
+        }
+        return;
+    }
 
-    TU_ASSERT(len <= sbc_itf->epout_size);
-    TU_VERIFY(usbh_edpt_claim(dev_addr, sbc_itf->ep_out));
+    sbc_itf->leds_inflight = false;
 
-    memcpy(sbc_itf->epout_buf, txbuf, len);
-    return usbh_edpt_xfer(dev_addr, sbc_itf->ep_out, sbc_itf->epout_buf, len);
+    if (tuh_sbc_report_sent_cb)
+    {
+        tuh_sbc_report_sent_cb(dev_addr, instance, buf, len);
+    }
 }
 
+static vendorh_class_t const sbc_class =
+{
+    .id              = VENDORH_CLASS_SBC,
+    .itf_max         = CFG_TUH_SBC,
+    .flags           = CFG_TUH_SBC_REPORT_ON_CHANGE ? VENDORH_CLASS_REPORT_ON_CHANGE : 0,
+    .name            = "SBC",
+    .devs            = _sbch_dev,
+    .dev_size        = sizeof(sbch_device_t),
+    .itf_offset      = offsetof(sbch_device_t, instances),
+    .itf_size        = sizeof(sbch_interface_t),
+    .pad_offset      = offsetof(sbch_interface_t, pad),
+    .delta_offset    = offsetof(sbch_interface_t, delta),
+    .pad_size        = sizeof(sbc_gamepad_t),
+    .delta_size      = sizeof(sbc_gamepad_delta_t),
+    .epin_offset     = offsetof(sbch_interface_t, epin_buf),
+    .epin_bufsize    = CFG_TUH_SBC_EPIN_BUFSIZE,
+    .epout_offset    = offsetof(sbch_interface_t, epout_buf),
+    .epout_bufsize   = CFG_TUH_SBC_EPOUT_BUFSIZE,
+#if CFG_TUH_SBC_STATS
+    .stats_offset    = offsetof(sbch_interface_t, stats),
+#endif
+#if CFG_TUH_SBC_RECOVERY
+    .recovery_offset = offsetof(sbch_interface_t, recovery),
+#endif
+#if CFG_TUH_SBC_RING_SIZE
+    .ring_idx_offset = offsetof(sbch_interface_t, ring_idx),
+    .ring_offset     = offsetof(sbch_interface_t, ring),
+    .ring_entry_size = sizeof(sbc_gamepad_entry_t),
+    .ring_depth      = CFG_TUH_SBC_RING_SIZE,
+    .ring_entry_pad  = offsetof(sbc_gamepad_entry_t, pad),
+#endif
+#if CFG_TUH_SBC_AXIS_CAL
+    .axis_count      = SBC_AXIS_COUNT,
+    .axis_offset     = offsetof(sbch_interface_t, axis_cal),
+    .axes_offset     = offsetof(sbch_interface_t, axes),
+    .axis_src        = axis_src,
+    .axis_default    = axis_default,
+#endif
+    .match           = sbc_match,
+    .mount           = sbc_mount,
+    .umount          = sbc_umount,
+    .decode          = sbc_decode,
+    .diff            = sbc_diff,
+    .notify          = sbc_notify,
+    .build_out       = leds_build,
+    .out_done        = sbc_out_done,
+    .time_us         = tuh_sbc_time_us_cb,
+    .link            = tuh_sbc_link_cb,
+};
+
 //--------------------------------------------------------------------+
-// USBH API
+// Interface API
 //--------------------------------------------------------------------+
-void sbch_init(void)
+
+bool tuh_sbc_get_state(uint8_t dev_addr, uint8_t instance, sbc_gamepad_t *pad)
 {
-    tu_memclr(_sbch_dev, sizeof(_sbch_dev));
+    return vendorh_get_pad(&sbc_class, dev_addr, instance, pad);
 }
 
-bool sbch_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *desc_itf, uint16_t max_len)
+bool tuh_sbc_get_report_time(uint8_t dev_addr, uint8_t instance, vendorh_report_time_t *report_time)
 {
-    TU_VERIFY(dev_addr <= CFG_TUH_DEVICE_MAX);
+    return vendorh_get_report_time(&sbc_class, dev_addr, instance, report_time);
+}
 
-    uint16_t PID, VID;
-    tuh_vid_pid_get(dev_addr, &VID, &PID);
+#if CFG_TUH_SBC_AXIS_CAL
+bool tuh_sbc_get_axes(uint8_t dev_addr, uint8_t instance, int16_t *axes)
+{
+    return vendorh_get_axes(&sbc_class, dev_addr, instance, axes);
+}
 
-    if (VID != 0x0A7B && PID != 0xD000 &&
-        desc_itf->bInterfaceClass != 0x58 &&  //XboxOG bInterfaceClass
-        desc_itf->bInterfaceSubClass != 0x42) //XboxOG bInterfaceSubClass
-    {
-        TU_LOG2("SBC: not a known device\n");
-        return false;
-    }
+bool tuh_sbc_set_axis_cal(uint8_t dev_addr, uint8_t instance, sbc_axis_t axis, vendorh_axis_cal_t const *cal)
+{
+    return vendorh_set_axis_cal(&sbc_class, dev_addr, instance, (uint8_t)axis, cal);
+}
 
-    TU_LOG2("SBC opening Interface %u (addr = %u)\r\n", desc_itf->bInterfaceNumber, dev_addr);
+bool tuh_sbc_get_axis_cal(uint8_t dev_addr, uint8_t instance, sbc_axis_t axis, vendorh_axis_cal_t *cal)
+{
+    return vendorh_get_axis_cal(&sbc_class, dev_addr, instance, (uint8_t)axis, cal);
+}
 
-    sbch_device_t *sbc_dev = get_dev(dev_addr);
-    TU_ASSERT(sbc_dev->inst_count < CFG_TUH_SBC, 0);
+bool tuh_sbc_axis_autocal(uint8_t dev_addr, uint8_t instance, sbc_axis_t axis, bool enable)
+{
+    return vendorh_set_autocal(&sbc_class, dev_addr, instance, (uint8_t)axis, enable);
+}
+#endif
 
-    sbch_interface_t *sbc_itf = get_instance(dev_addr, sbc_dev->inst_count);
-    sbc_itf->itf_num = desc_itf->bInterfaceNumber;
+#if CFG_TUH_SBC_STATS
+bool tuh_sbc_get_stats(uint8_t dev_addr, uint8_t instance, vendorh_stats_t *stats)
+{
+    return vendorh_get_stats(&sbc_class, dev_addr, instance, stats);
+}
 
-    //Parse descriptor for all endpoints and open them
-    uint8_t const *p_desc = (uint8_t const *)desc_itf;
-    int endpoint = 0;
-    int pos = 0;
-    while (endpoint < desc_itf->bNumEndpoints && pos < max_len)
-    {
-        if (tu_desc_type(p_desc) != TUSB_DESC_ENDPOINT)
-        {
-            pos += tu_desc_len(p_desc);
-            p_desc = tu_desc_next(p_desc);
-            continue;
-        }
-        tusb_desc_endpoint_t const *desc_ep = (tusb_desc_endpoint_t const *)p_desc;
-        TU_ASSERT(TUSB_DESC_ENDPOINT == desc_ep->bDescriptorType);
-        TU_ASSERT(tuh_edpt_open(dev_addr, desc_ep));
-        if (tu_edpt_dir(desc_ep->bEndpointAddress) == TUSB_DIR_OUT)
-        {
-            sbc_itf->ep_out = desc_ep->bEndpointAddress;
-            sbc_itf->epout_size = tu_edpt_packet_size(desc_ep);
-        }
-        else
-        {
-            sbc_itf->ep_in = desc_ep->bEndpointAddress;
-            sbc_itf->epin_size = tu_edpt_packet_size(desc_ep);
-        }
-        endpoint++;
-        pos += tu_desc_len(p_desc);
-        p_desc = tu_desc_next(p_desc);
-    }
+void tuh_sbc_reset_stats(uint8_t dev_addr, uint8_t instance)
+{
+    vendorh_reset_stats(&sbc_class, dev_addr, instance);
+}
+#endif
 
-    sbc_dev->inst_count++;
-    return true;
+bool tuh_sbc_receive_report(uint8_t dev_addr, uint8_t instance)
+{
+    return vendorh_receive_report(&sbc_class, dev_addr, instance);
 }
 
-bool sbch_set_config(uint8_t dev_addr, uint8_t itf_num)
+#if CFG_TUH_SBC_AUTO_POLL
+bool tuh_sbc_start_polling(uint8_t dev_addr, uint8_t instance)
 {
-    uint8_t instance = get_instance_id_by_itfnum(dev_addr, itf_num);
-    sbch_interface_t *sbc_itf = get_instance(dev_addr, instance);
-    sbc_itf->connected = true;
+    return vendorh_start_polling(&sbc_class, dev_addr, instance);
+}
 
-    if (tuh_sbc_mount_cb)
-    {
-        tuh_sbc_mount_cb(dev_addr, instance, sbc_itf);
-    }
+void tuh_sbc_stop_polling(uint8_t dev_addr, uint8_t instance)
+{
+    vendorh_stop_polling(&sbc_class, dev_addr, instance);
+}
 
-    usbh_driver_set_config_complete(dev_addr, sbc_itf->itf_num);
-    return true;
+bool tuh_sbc_is_polling(uint8_t dev_addr, uint8_t instance)
+{
+    return vendorh_is_polling(&sbc_class, dev_addr, instance);
 }
+#endif
 
-bool sbch_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+#if CFG_TUH_SBC_RING_SIZE
+bool tuh_sbc_ring_pop(uint8_t dev_addr, uint8_t instance, sbc_gamepad_entry_t *entry)
 {
-    if (result != XFER_RESULT_SUCCESS)
-    {
-        TU_LOG1("Error: %d\n", result);
-        return false;
-    }
+    return vendorh_ring_pop(&sbc_class, dev_addr, instance, entry);
+}
+#endif
+
+bool tuh_sbc_set_leds(uint8_t dev_addr, uint8_t instance, const sbc_leds_t *value)
+{
+    sbch_interface_t *sbc_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(sbc_itf);
 
-    uint8_t const dir = tu_edpt_dir(ep_addr);
-    uint8_t const instance = get_instance_id_by_epaddr(dev_addr, ep_addr);
-    sbch_interface_t *sbc_itf = get_instance(dev_addr, instance);
-    sbc_gamepad_t *pad = &sbc_itf->pad;
-    uint8_t *rdata = sbc_itf->epin_buf;
+#if CFG_TUH_SBC_STATS
+    if (sbc_itf->leds_pending)
+        sbc_itf->stats.out_coalesced++;
+#endif
 
-    if (dir == TUSB_DIR_IN)
-    {
-        TU_LOG2("Get Report callback (%u, %u, %u bytes)\r\n", dev_addr, instance, xferred_bytes);
-        TU_LOG2_MEM(sbc_itf->epin_buf, xferred_bytes, 2);
+    sbc_itf->leds = *value;
+    sbc_itf->leds_pending = true;
 
+    return vendorh_out_flush(&sbc_class, dev_addr, instance);
+}
 
-        if (xferred_bytes == 26 && (rdata[6] & 0x80) == 0x80 && rdata[7] == 0x00 && (rdata[24] & 0xF0) == 0x00)
-        {
-            tu_memclr(pad, sizeof(sbc_gamepad_t));
-
-            pad->bButtons       = (uint64_t)(rdata[6] & 0x7F) << 32 | (uint64_t)rdata[5] << 24 | rdata[4] << 16 | rdata[3] << 8 | rdata[2];
-            pad->bAimingX       = rdata[9];
-            pad->bAimingY       = rdata[11];
-            pad->bRotationLever = rdata[13];
-            pad->bSightChangeX  = rdata[15];
-            pad->bSightChangeY  = rdata[17];
-            pad->bLeftPedal     = rdata[19];
-            pad->bMiddlePedal   = rdata[21];
-            pad->bRightPedal    = rdata[23];
-            pad->bTunerDial     = rdata[24] & 0x0F;
-            pad->bGearLever     = rdata[25];
-
-            sbc_itf->new_pad_data = true;
-        }
+bool tuh_sbc_set_led(uint8_t dev_addr, uint8_t instance, sbc_led_t led, uint8_t intensity)
+{
+    sbch_interface_t *sbc_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(sbc_itf && led < SBC_LED_COUNT);
 
-        tuh_sbc_report_received_cb(dev_addr, instance, (const uint8_t *)sbc_itf, sizeof(sbch_interface_t));
-        sbc_itf->new_pad_data = false;
-    }
-    else
+#if CFG_TUH_SBC_STATS
+    if (sbc_itf->leds_pending)
+        sbc_itf->stats.out_coalesced++;
+#endif
+
+    // two LEDs per byte, the first one in the low nibble
+    uint8_t *leds = (uint8_t *)&sbc_itf->leds;
+    uint8_t const shift = (led & 1) ? 4 : 0;
+    leds[led >> 1] = (uint8_t)((leds[led >> 1] & ~(0x0F << shift)) | ((intensity & 0x0F) << shift));
+    sbc_itf->leds_pending = true;
+
+    return vendorh_out_flush(&sbc_class, dev_addr, instance);
+}
+
+bool tuh_sbc_send_report(uint8_t dev_addr, uint8_t instance, const uint8_t *txbuf, uint16_t len)
+{
+    sbch_interface_t *sbc_itf = find_instance(dev_addr, instance);
+    TU_VERIFY(sbc_itf);
+    TU_ASSERT(len <= sbc_itf->base.epout_size);
+
+    TU_VERIFY(usbh_edpt_claim(dev_addr, sbc_itf->base.ep_out));
+
+    memcpy(sbc_itf->epout_buf, txbuf, len);
+    if (!usbh_edpt_xfer(dev_addr, sbc_itf->base.ep_out, sbc_itf->epout_buf, len))
     {
-        if (tuh_sbc_report_sent_cb)
-        {
-            tuh_sbc_report_sent_cb(dev_addr, instance, sbc_itf->epout_buf, xferred_bytes);
-        }
+        usbh_edpt_release(dev_addr, sbc_itf->base.ep_out);
+        return false;
     }
 
+    // a raw frame may drive the LEDs: the next LED state goes out even if unchanged
+    sbc_itf->leds_sent_valid = false;
     return true;
 }
 
-void sbch_close(uint8_t dev_addr)
+void tuh_sbc_task(uint32_t now_ms)
 {
-    TU_VERIFY(dev_addr <= CFG_TUH_DEVICE_MAX, );
-    sbch_device_t *sbc_dev = get_dev(dev_addr);
+    vendorh_task(&sbc_class, now_ms);
+}
 
-    for (uint8_t inst = 0; inst < sbc_dev->inst_count; inst++)
-    {
-        if (tuh_sbc_umount_cb)
-        {
-            tuh_sbc_umount_cb(dev_addr, inst);
-        }
-    }
-    tu_memclr(sbc_dev, sizeof(sbch_device_t));
+#if CFG_TUH_VENDORH_TRACE
+bool tuh_sbc_replay(uint8_t dev_addr, uint8_t instance, uint8_t ep_addr, xfer_result_t result, uint8_t const *data, uint16_t len)
+{
+    return vendorh_replay(&sbc_class, dev_addr, instance, ep_addr, result, data, len);
+}
+#endif
+
+//--------------------------------------------------------------------+
+// USBH API
+//--------------------------------------------------------------------+
+void sbch_init(void)
+{
+    vendorh_init(&sbc_class);
+}
+
+bool sbch_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *desc_itf, uint16_t max_len)
+{
+    (void)rhport;
+    return vendorh_open(&sbc_class, dev_addr, desc_itf, max_len);
+}
+
+bool sbch_set_config(uint8_t dev_addr, uint8_t itf_num)
+{
+    return vendorh_set_config(&sbc_class, dev_addr, itf_num);
+}
+
+bool sbch_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+    return vendorh_xfer_cb(&sbc_class, dev_addr, ep_addr, result, xferred_bytes);
+}
+
+void sbch_close(uint8_t dev_addr)
+{
+    vendorh_close(&sbc_class, dev_addr);
 }
 
 #endif
@@ -11,6 +11,8 @@
 #ifndef _TUSB_SBC_HOST_H_
 #define _TUSB_SBC_HOST_H_
 
+#include "../common/vendorh_core.h"
+
 #ifdef __cplusplus
  extern "C" {
 #endif
@@ -27,6 +29,38 @@
 #define CFG_TUH_SBC_EPOUT_BUFSIZE 64
 #endif
 
+// Re-queue the IN transfer from the xfer callback so every bInterval is used
+#ifndef CFG_TUH_SBC_AUTO_POLL
+#define CFG_TUH_SBC_AUTO_POLL 0
+#endif
+
+// Only invoke tuh_sbc_report_received_cb when the decoded pad changed
+#ifndef CFG_TUH_SBC_REPORT_ON_CHANGE
+#define CFG_TUH_SBC_REPORT_ON_CHANGE 0
+#endif
+
+// Depth of the per-instance ring of decoded pads (power of two, 0 to disable)
+#ifndef CFG_TUH_SBC_RING_SIZE
+#define CFG_TUH_SBC_RING_SIZE 0
+#endif
+
+
+// Normalized signed 16-bit axes through per-axis calibration tables,
+// 512 bytes of RAM per axis and instance
+#ifndef CFG_TUH_SBC_AXIS_CAL
+#define CFG_TUH_SBC_AXIS_CAL 0
+#endif
+
+// Per-instance counters and latency histograms, see tuh_sbc_get_stats
+#ifndef CFG_TUH_SBC_STATS
+#define CFG_TUH_SBC_STATS 0
+#endif
+
+// Clear halts and re-arm failed IN transfers with backoff, driven by tuh_sbc_task
+#ifndef CFG_TUH_SBC_RECOVERY
+#define CFG_TUH_SBC_RECOVERY 0
+#endif
+
 #define MAX_PACKET_SIZE 32
 
 // to do: add button mask
@@ -46,6 +80,47 @@ typedef struct sbc_gamepad
     uint8_t bGearLever;
 } sbc_gamepad_t;
 
+// sbc_gamepad_delta_t::changed bits
+#define SBC_FIELD_BUTTONS        0x0001
+#define SBC_FIELD_ROTATION_LEVER 0x0002
+#define SBC_FIELD_SIGHT_CHANGE_X 0x0004
+#define SBC_FIELD_SIGHT_CHANGE_Y 0x0008
+#define SBC_FIELD_AIMING_X       0x0010
+#define SBC_FIELD_AIMING_Y       0x0020
+#define SBC_FIELD_LEFT_PEDAL     0x0040
+#define SBC_FIELD_MIDDLE_PEDAL   0x0080
+#define SBC_FIELD_RIGHT_PEDAL    0x0100
+#define SBC_FIELD_TUNER_DIAL     0x0200
+#define SBC_FIELD_GEAR_LEVER     0x0400
+
+typedef struct
+{
+    uint16_t changed;  // SBC_FIELD_* that differ from the previous pad
+    uint64_t pressed;  // bButtons bits that went from 0 to 1
+    uint64_t released; // bButtons bits that went from 1 to 0
+} sbc_gamepad_delta_t;
+
+typedef enum
+{
+    SBC_AXIS_AIMING_X,
+    SBC_AXIS_AIMING_Y,
+    SBC_AXIS_ROTATION_LEVER,
+    SBC_AXIS_SIGHT_CHANGE_X,
+    SBC_AXIS_SIGHT_CHANGE_Y,
+    SBC_AXIS_LEFT_PEDAL,
+    SBC_AXIS_MIDDLE_PEDAL,
+    SBC_AXIS_RIGHT_PEDAL,
+    SBC_AXIS_COUNT
+} sbc_axis_t;
+
+typedef struct
+{
+    uint32_t timestamp_us; // from tuh_sbc_time_us_cb
+    uint32_t frame;        // host SOF frame number
+    uint32_t seq;          // increments on every decoded report, gaps mean dropped entries
+    sbc_gamepad_t pad;
+} sbc_gamepad_entry_t;
+
 typedef struct sbc_leds
 {
     uint8_t EmergencyEject : 4;
@@ -88,38 +163,155 @@ typedef struct sbc_leds
     uint8_t Gear5 : 4;
 } sbc_leds_t;
 
+// LED index for tuh_sbc_set_led, same order as sbc_leds_t
+typedef enum
+{
+    SBC_LED_EMERGENCY_EJECT = 0,
+    SBC_LED_COCKPIT_HATCH,
+    SBC_LED_IGNITION,
+    SBC_LED_START,
+    SBC_LED_OPEN_CLOSE,
+    SBC_LED_MAP_ZOOM_IN_OUT,
+    SBC_LED_MODE_SELECT,
+    SBC_LED_SUB_MONITOR_MODE_SELECT,
+    SBC_LED_MAIN_MONITOR_ZOOM_IN,
+    SBC_LED_MAIN_MONITOR_ZOOM_OUT,
+    SBC_LED_FORECAST_SHOOTING_SYSTEM,
+    SBC_LED_MANIPULATOR,
+    SBC_LED_LINE_COLOR_CHANGE,
+    SBC_LED_WASHING,
+    SBC_LED_EXTINGUISHER,
+    SBC_LED_CHAFF,
+    SBC_LED_TANK_DETACH,
+    SBC_LED_OVERRIDE,
+    SBC_LED_NIGHT_SCOPE,
+    SBC_LED_F1,
+    SBC_LED_F2,
+    SBC_LED_F3,
+    SBC_LED_MAIN_WEAPON_CONTROL,
+    SBC_LED_SUB_WEAPON_CONTROL,
+    SBC_LED_MAGAZINE_CHANGE,
+    SBC_LED_COMM1,
+    SBC_LED_COMM2,
+    SBC_LED_COMM3,
+    SBC_LED_COMM4,
+    SBC_LED_COMM5,
+    SBC_LED_UNUSED,
+    SBC_LED_GEAR_R,
+    SBC_LED_GEAR_N,
+    SBC_LED_GEAR_1,
+    SBC_LED_GEAR_2,
+    SBC_LED_GEAR_3,
+    SBC_LED_GEAR_4,
+    SBC_LED_GEAR_5,
+    SBC_LED_COUNT
+} sbc_led_t;
+
+#define SBC_LEDS_REPORT_SIZE 22
+
 typedef struct
 {
+    vendorh_itf_t base; // connection, endpoints and pad_seq, see vendorh_core.h
     sbc_gamepad_t pad;
-    uint8_t connected;
-    uint8_t new_pad_data;
-    uint8_t itf_num;
-    uint8_t ep_in;
-    uint8_t ep_out;
-
-    uint16_t epin_size;
-    uint16_t epout_size;
+    sbc_gamepad_delta_t delta; // pad changes made by the last report
+#if CFG_TUH_SBC_AXIS_CAL
+    int16_t axes[SBC_AXIS_COUNT];       // normalized pad axes, guarded by base.pad_seq
+    vendorh_axis_t axis_cal[SBC_AXIS_COUNT];
+#endif
 
-    uint8_t epin_buf[CFG_TUH_SBC_EPIN_BUFSIZE];
+    // IN transfers alternate between the two buffers so the next one
+    // can be queued while the previous report is still being decoded
+    uint8_t epin_buf[2][CFG_TUH_SBC_EPIN_BUFSIZE];
     uint8_t epout_buf[CFG_TUH_SBC_EPOUT_BUFSIZE];
+
+    sbc_leds_t leds;      // wanted LED state
+    sbc_leds_t leds_sent; // LED state of the last frame queued, in flight or completed
+    uint8_t leds_sent_valid;
+    uint8_t leds_pending;  // leds changed and not queued yet
+    uint8_t leds_inflight; // epout_buf holds a LED frame being sent
+
+#if CFG_TUH_SBC_RING_SIZE
+    // single producer (USB task) / single consumer ring
+    vendorh_ring_t ring_idx;
+    sbc_gamepad_entry_t ring[CFG_TUH_SBC_RING_SIZE];
+#endif
+
+#if CFG_TUH_SBC_STATS
+    vendorh_stats_t stats;
+#endif
+
+#if CFG_TUH_SBC_RECOVERY
+    vendorh_recovery_t recovery;
+#endif
 } sbch_interface_t;
 
 //--------------------------------------------------------------------+
 // Callbacks
 //--------------------------------------------------------------------+
 
-void tuh_sbc_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
+// Implement either one (or both) of the report callbacks.
+// pad_received is only invoked for valid reports and gets the decoded pad,
+// what changed since the previous one and the raw report, without copies.
+TU_ATTR_WEAK void tuh_sbc_pad_received_cb(uint8_t dev_addr, uint8_t instance, sbc_gamepad_t const *pad, sbc_gamepad_delta_t const *delta, uint8_t const *report, uint16_t len);
+// report points to the whole sbch_interface_t
+TU_ATTR_WEAK void tuh_sbc_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
 TU_ATTR_WEAK void tuh_sbc_report_sent_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
 TU_ATTR_WEAK void tuh_sbc_umount_cb(uint8_t dev_addr, uint8_t instance);
 TU_ATTR_WEAK void tuh_sbc_mount_cb(uint8_t dev_addr, uint8_t instance, const sbch_interface_t *sbc_itf);
 
+// Microsecond clock used to timestamp reports, e.g. time_us_32() on RP2040
+TU_ATTR_WEAK uint32_t tuh_sbc_time_us_cb(void);
+
+// IN transfers started failing (VENDORH_LINK_DEGRADED) or work again (VENDORH_LINK_UP)
+TU_ATTR_WEAK void tuh_sbc_link_cb(uint8_t dev_addr, uint8_t instance, vendorh_link_t link);
+
 //--------------------------------------------------------------------+
 // Interface API
 //--------------------------------------------------------------------+
 
 bool tuh_sbc_receive_report(uint8_t dev_addr, uint8_t instance);
+// Copy of the latest decoded pad, safe to call from any core or task
+bool tuh_sbc_get_state(uint8_t dev_addr, uint8_t instance, sbc_gamepad_t *pad);
+// Arrival time and SOF frame of the report the pad was decoded from
+bool tuh_sbc_get_report_time(uint8_t dev_addr, uint8_t instance, vendorh_report_time_t *report_time);
+#if CFG_TUH_SBC_AXIS_CAL
+// Normalized copy of the latest pad axes, SBC_AXIS_COUNT values indexed by sbc_axis_t
+bool tuh_sbc_get_axes(uint8_t dev_addr, uint8_t instance, int16_t *axes);
+bool tuh_sbc_set_axis_cal(uint8_t dev_addr, uint8_t instance, sbc_axis_t axis, vendorh_axis_cal_t const *cal);
+bool tuh_sbc_get_axis_cal(uint8_t dev_addr, uint8_t instance, sbc_axis_t axis, vendorh_axis_cal_t *cal);
+// Learn min/max from the next reports, move the axis to both ends
+bool tuh_sbc_axis_autocal(uint8_t dev_addr, uint8_t instance, sbc_axis_t axis, bool enable);
+#endif
+#if CFG_TUH_SBC_STATS
+// Copy of the instance counters, call from the USB host task
+bool tuh_sbc_get_stats(uint8_t dev_addr, uint8_t instance, vendorh_stats_t *stats);
+void tuh_sbc_reset_stats(uint8_t dev_addr, uint8_t instance);
+#endif
+#if CFG_TUH_SBC_AUTO_POLL
+bool tuh_sbc_start_polling(uint8_t dev_addr, uint8_t instance);
+void tuh_sbc_stop_polling(uint8_t dev_addr, uint8_t instance);
+// False once polling stopped on its own, after a failed re-arm or an IN error without recovery
+bool tuh_sbc_is_polling(uint8_t dev_addr, uint8_t instance);
+#endif
+#if CFG_TUH_SBC_RING_SIZE
+// Safe to call from another core than the one running the USB host task
+bool tuh_sbc_ring_pop(uint8_t dev_addr, uint8_t instance, sbc_gamepad_entry_t *entry);
+#endif
+// Raw OUT frame, false while another frame is in flight. The driver cannot tell
+// what it does to the LEDs, so the next LED update is always sent.
 bool tuh_sbc_send_report(uint8_t dev_addr, uint8_t instance, const uint8_t *txbuf, uint16_t len);
+// LED state is kept by the driver. A frame is only sent when the state differs
+// from the last one queued, updates made while a frame is in flight are merged.
 bool tuh_sbc_set_leds(uint8_t dev_addr, uint8_t instance, const sbc_leds_t *value);
+bool tuh_sbc_set_led(uint8_t dev_addr, uint8_t instance, sbc_led_t led, uint8_t intensity);
+// Call periodically from the main loop with a millisecond clock, in the
+// context that runs tuh_task: it shares driver state with the transfer callbacks
+void tuh_sbc_task(uint32_t now_ms);
+#if CFG_TUH_VENDORH_TRACE
+// Feed a captured transfer to a mounted instance as if it just completed,
+// e.g. from vendorh_trace_replay in a host test
+bool tuh_sbc_replay(uint8_t dev_addr, uint8_t instance, uint8_t ep_addr, xfer_result_t result, uint8_t const *data, uint16_t len);
+#endif
 
 //--------------------------------------------------------------------+
 // Internal Class Driver API
@@ -0,0 +1,150 @@
+// Cost of handling one IN report per driver, from *_xfer_cb entry to
+// tuh_*_report_received_cb, and IN reports per second including the re-arm
+// and the mock's copy of the report into the transfer buffer.
+//
+//   make bench
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "mock_usbh.h"
+#include "sbc/sbc_host.h"
+#include "guncon2/guncon2_host.h"
+#include "densha/densha_host.h"
+
+enum { REPORTS = 1024, ROUNDS = 2000 };
+
+static uint8_t reports[REPORTS][26];
+static volatile uint32_t sink;
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TICK_UNIT "cycles"
+static inline uint64_t ticks(void)
+{
+    return __rdtsc();
+}
+#else
+#define TICK_UNIT "ns"
+static inline uint64_t ticks(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+// xfer_cb entry of the report in flight, and the intervals seen so far
+static uint64_t entry;
+static uint64_t total;
+static uint64_t best;
+static uint32_t received;
+
+static void received_at(uint8_t const *report)
+{
+    uint64_t const dt = ticks() - entry;
+    total += dt;
+    if (dt < best)
+        best = dt;
+    received++;
+    sink += report[1];
+}
+
+void tuh_sbc_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len)
+{
+    (void)dev_addr; (void)instance; (void)len;
+    received_at(report);
+}
+
+void tuh_guncon2_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len)
+{
+    (void)dev_addr; (void)instance; (void)len;
+    received_at(report);
+}
+
+void tuh_densha_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len)
+{
+    (void)dev_addr; (void)instance; (void)len;
+    received_at(report);
+}
+
+// Stamp the entry of the driver callback the mock completes the transfer with
+static mock_xfer_cb_t driver_cb;
+
+static bool xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+    entry = ticks();
+    return driver_cb(dev_addr, ep_addr, result, xferred_bytes);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void run(char const *name, bool (*receive)(uint8_t, uint8_t), mock_xfer_cb_t cb, uint16_t len)
+{
+    driver_cb = cb;
+    total = 0;
+    best = UINT64_MAX;
+    received = 0;
+
+    double const start = now_s();
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        for (int i = 0; i < REPORTS; i++)
+        {
+            receive(1, 0);
+            mock_complete(xfer_cb, 1, MOCK_EP_IN, reports[i], len, XFER_RESULT_SUCCESS);
+        }
+    }
+    double const elapsed = now_s() - start;
+
+    assert(received);
+    printf("%-8s %7.1f %s/report (min %llu)  %6.2f M reports/s\n", name, (double)total / received, TICK_UNIT,
+           (unsigned long long)best, (double)ROUNDS * REPORTS / elapsed * 1e-6);
+}
+
+int main(void)
+{
+    srand(1);
+    for (int i = 0; i < REPORTS; i++)
+    {
+        uint8_t *r = reports[i];
+        for (int j = 0; j < 26; j++)
+            r[j] = (uint8_t)rand();
+    }
+
+    // valid for SBC (26 bytes)
+    for (int i = 0; i < REPORTS; i++)
+    {
+        reports[i][6] |= 0x80;
+        reports[i][7] = 0;
+        reports[i][24] &= 0x0F;
+    }
+    mock_reset();
+    sbch_init();
+    assert(mock_mount(sbch_open, sbch_set_config, 1, 0x0A7B, 0xD000));
+    run("sbc", tuh_sbc_receive_report, sbch_xfer_cb, 26);
+
+    // GunCon2 accepts any 6 byte report
+    mock_reset();
+    guncon2h_init();
+    assert(mock_mount(guncon2h_open, guncon2h_set_config, 1, 0x0B9A, 0x016A));
+    run("guncon2", tuh_guncon2_receive_report, guncon2h_xfer_cb, 6);
+
+    // valid for the Densha type 2 (6 bytes)
+    for (int i = 0; i < REPORTS; i++)
+    {
+        reports[i][0] = 1;
+        reports[i][1] |= 1;
+    }
+    mock_reset();
+    denshah_init();
+    assert(mock_mount(denshah_open, denshah_set_config, 1, DENSHA_VID_TAITO, DENSHA_PID_PS2TYPE2));
+    run("densha", tuh_densha_receive_report, denshah_xfer_cb, 6);
+
+    return 0;
+}
@@ -0,0 +1,210 @@
+#include "mock_usbh.h"
+#include "host/hcd.h"
+
+uint8_t const mock_desc[MOCK_DESC_LEN] =
+{
+    9, TUSB_DESC_INTERFACE, 0, 0, 2, 0x58, 0x42, 0, 0,
+    7, TUSB_DESC_ENDPOINT, MOCK_EP_IN, 3, 32, 0, 4,
+    7, TUSB_DESC_ENDPOINT, MOCK_EP_OUT, 3, 32, 0, 4,
+};
+
+uint16_t mock_vid;
+uint16_t mock_pid;
+uint32_t mock_frame;
+
+int mock_xfers_in;
+int mock_xfers_out;
+int mock_ctrl_count;
+int mock_clear_stall_count;
+uint8_t mock_clear_stall_ep;
+bool mock_ctrl_reject;
+bool mock_xfer_reject;
+tusb_control_request_t mock_ctrl_req;
+uint8_t mock_ctrl_buf[64];
+
+typedef struct
+{
+    uint8_t claimed;
+    uint8_t busy;
+    uint8_t *buf;
+    uint16_t len;
+} mock_edpt_t;
+
+static mock_edpt_t _edpt[CFG_TUH_DEVICE_MAX + 1][2][16];
+static tuh_xfer_t _ctrl_xfer;
+static bool _ctrl_pending;
+
+static mock_edpt_t *get_edpt(uint8_t dev_addr, uint8_t ep_addr)
+{
+    assert(dev_addr <= CFG_TUH_DEVICE_MAX);
+    return &_edpt[dev_addr][tu_edpt_dir(ep_addr)][tu_edpt_number(ep_addr) & 0x0F];
+}
+
+void mock_reset(void)
+{
+    memset(_edpt, 0, sizeof(_edpt));
+    memset(&_ctrl_xfer, 0, sizeof(_ctrl_xfer));
+    _ctrl_pending = false;
+    mock_frame = 0;
+    mock_xfers_in = 0;
+    mock_xfers_out = 0;
+    mock_ctrl_count = 0;
+    mock_clear_stall_count = 0;
+    mock_clear_stall_ep = 0;
+    mock_ctrl_reject = false;
+    mock_xfer_reject = false;
+}
+
+bool mock_mount(mock_open_t open, mock_set_config_t set_config, uint8_t dev_addr, uint16_t vid, uint16_t pid)
+{
+    mock_vid = vid;
+    mock_pid = pid;
+    if (!open(0, dev_addr, (tusb_desc_interface_t const *)mock_desc, MOCK_DESC_LEN))
+        return false;
+    return set_config(dev_addr, 0);
+}
+
+bool mock_edpt_busy(uint8_t dev_addr, uint8_t ep_addr)
+{
+    return get_edpt(dev_addr, ep_addr)->busy;
+}
+
+uint8_t *mock_edpt_buf(uint8_t dev_addr, uint8_t ep_addr)
+{
+    return get_edpt(dev_addr, ep_addr)->buf;
+}
+
+bool mock_complete(mock_xfer_cb_t xfer_cb, uint8_t dev_addr, uint8_t ep_addr, uint8_t const *data, uint32_t len, xfer_result_t result)
+{
+    mock_edpt_t *ep = get_edpt(dev_addr, ep_addr);
+    assert(ep->busy);
+
+    if (data)
+        memcpy(ep->buf, data, len);
+
+    // like usbh, the endpoint is free again when the driver is called
+    ep->busy = 0;
+    ep->claimed = 0;
+    return xfer_cb(dev_addr, ep_addr, result, len);
+}
+
+bool mock_ctrl_pending(void)
+{
+    return _ctrl_pending;
+}
+
+bool mock_ctrl_complete(xfer_result_t result)
+{
+    if (!_ctrl_pending)
+        return false;
+
+    tuh_xfer_t xfer = _ctrl_xfer;
+    xfer.result = result;
+    xfer.setup = &mock_ctrl_req;
+    _ctrl_pending = false;
+
+    if (xfer.complete_cb)
+        xfer.complete_cb(&xfer);
+    return true;
+}
+
+//--------------------------------------------------------------------+
+// tinyusb host API used by the drivers
+//--------------------------------------------------------------------+
+
+bool usbh_edpt_claim(uint8_t dev_addr, uint8_t ep_addr)
+{
+    mock_edpt_t *ep = get_edpt(dev_addr, ep_addr);
+    if (ep->claimed || ep->busy)
+        return false;
+
+    ep->claimed = 1;
+    return true;
+}
+
+bool usbh_edpt_release(uint8_t dev_addr, uint8_t ep_addr)
+{
+    get_edpt(dev_addr, ep_addr)->claimed = 0;
+    return true;
+}
+
+bool usbh_edpt_xfer(uint8_t dev_addr, uint8_t ep_addr, uint8_t *buffer, uint16_t total_bytes)
+{
+    mock_edpt_t *ep = get_edpt(dev_addr, ep_addr);
+    assert(ep->claimed && !ep->busy);
+    if (mock_xfer_reject)
+        return false;
+
+    ep->busy = 1;
+    ep->buf = buffer;
+    ep->len = total_bytes;
+
+    if (tu_edpt_dir(ep_addr) == TUSB_DIR_IN)
+        mock_xfers_in++;
+    else
+        mock_xfers_out++;
+    return true;
+}
+
+bool usbh_edpt_busy(uint8_t dev_addr, uint8_t ep_addr)
+{
+    return get_edpt(dev_addr, ep_addr)->busy;
+}
+
+void usbh_driver_set_config_complete(uint8_t dev_addr, uint8_t itf_num)
+{
+    (void)dev_addr;
+    (void)itf_num;
+}
+
+uint8_t usbh_get_rhport(uint8_t dev_addr)
+{
+    (void)dev_addr;
+    return 0;
+}
+
+bool tuh_vid_pid_get(uint8_t dev_addr, uint16_t *vid, uint16_t *pid)
+{
+    (void)dev_addr;
+    *vid = mock_vid;
+    *pid = mock_pid;
+    return true;
+}
+
+bool tuh_edpt_open(uint8_t dev_addr, tusb_desc_endpoint_t const *desc_ep)
+{
+    (void)dev_addr;
+    (void)desc_ep;
+    return true;
+}
+
+bool tuh_control_xfer(tuh_xfer_t *xfer)
+{
+    // one control transfer at a time, like EP0
+    if (mock_ctrl_reject || _ctrl_pending)
+        return false;
+
+    _ctrl_xfer = *xfer;
+    _ctrl_pending = true;
+    mock_ctrl_count++;
+    mock_ctrl_req = *xfer->setup;
+    memset(mock_ctrl_buf, 0, sizeof(mock_ctrl_buf));
+    if (xfer->buffer)
+        memcpy(mock_ctrl_buf, xfer->buffer, TU_MIN(mock_ctrl_req.wLength, sizeof(mock_ctrl_buf)));
+    return true;
+}
+
+uint32_t hcd_frame_number(uint8_t rhport)
+{
+    (void)rhport;
+    return mock_frame;
+}
+
+bool hcd_edpt_clear_stall(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr)
+{
+    (void)dev_addr;
+    assert(rhport == 0);
+    mock_clear_stall_ep = ep_addr;
+    mock_clear_stall_count++;
+    return true;
+}
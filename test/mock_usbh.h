@@ -0,0 +1,55 @@
+// Mock of the tinyusb host stack for the host tests and the benchmark.
+// Transfers are only recorded, the test completes them with mock_complete
+// and mock_ctrl_complete as if the device answered.
+
+#ifndef _MOCK_USBH_H_
+#define _MOCK_USBH_H_
+
+#include "tusb_option.h"
+#include "host/usbh.h"
+#include "host/usbh_classdriver.h"
+
+#include <assert.h>
+
+// descriptor of the mocked interface: IN endpoint 0x81, OUT endpoint 0x02
+#define MOCK_EP_IN   0x81
+#define MOCK_EP_OUT  0x02
+#define MOCK_DESC_LEN 23
+extern uint8_t const mock_desc[MOCK_DESC_LEN];
+
+typedef bool (*mock_xfer_cb_t)(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+typedef bool (*mock_open_t)(uint8_t rhport, uint8_t dev_addr, tusb_desc_interface_t const *desc_itf, uint16_t max_len);
+typedef bool (*mock_set_config_t)(uint8_t dev_addr, uint8_t itf_num);
+
+extern uint16_t mock_vid;
+extern uint16_t mock_pid;
+extern uint32_t mock_frame;       // returned by hcd_frame_number
+
+extern int mock_xfers_in;         // transfers queued per direction
+extern int mock_xfers_out;
+extern int mock_ctrl_count;       // control transfers accepted
+extern int mock_clear_stall_count;
+extern uint8_t mock_clear_stall_ep; // endpoint of the last hcd_edpt_clear_stall
+extern bool mock_ctrl_reject;     // tuh_control_xfer fails, as if EP0 was busy
+extern bool mock_xfer_reject;     // usbh_edpt_xfer fails
+extern tusb_control_request_t mock_ctrl_req; // last control request
+extern uint8_t mock_ctrl_buf[64]; // and its data stage
+
+// Clear all endpoint and control state
+void mock_reset(void);
+
+// Open the mocked interface on dev_addr with the driver and configure it
+bool mock_mount(mock_open_t open, mock_set_config_t set_config, uint8_t dev_addr, uint16_t vid, uint16_t pid);
+
+bool mock_edpt_busy(uint8_t dev_addr, uint8_t ep_addr);
+// Buffer of the transfer queued on the endpoint
+uint8_t *mock_edpt_buf(uint8_t dev_addr, uint8_t ep_addr);
+
+// Complete the transfer queued on ep_addr, data is what the device sent (IN only)
+bool mock_complete(mock_xfer_cb_t xfer_cb, uint8_t dev_addr, uint8_t ep_addr, uint8_t const *data, uint32_t len, xfer_result_t result);
+
+// Complete the pending control transfer, false if there is none
+bool mock_ctrl_complete(xfer_result_t result);
+bool mock_ctrl_pending(void);
+
+#endif /* _MOCK_USBH_H_ */
@@ -0,0 +1,145 @@
+// Replay a saved transfer trace into a driver on the PC and print every
+// decoded pad, e.g. a capture drained from vendorh_trace_ring_drain or
+// converted with tools/usbmon2trace.py.
+//
+//   make replay DRIVER=sbc TRACE=capture.bin
+
+#include "mock_usbh.h"
+#include "sbc/sbc_host.h"
+#include "guncon2/guncon2_host.h"
+#include "densha/densha_host.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t pads;
+static uint32_t failed;
+
+static void print_pad(void const *pad, uint16_t size)
+{
+    printf("%6u:", (unsigned)pads++);
+    for (uint16_t i = 0; i < size; i++)
+        printf(" %02x", ((uint8_t const *)pad)[i]);
+    printf("\n");
+}
+
+void tuh_sbc_pad_received_cb(uint8_t dev_addr, uint8_t instance, sbc_gamepad_t const *pad, sbc_gamepad_delta_t const *delta, uint8_t const *report, uint16_t len)
+{
+    (void)dev_addr; (void)instance; (void)delta; (void)report; (void)len;
+    print_pad(pad, sizeof(*pad));
+}
+
+void tuh_guncon2_pad_received_cb(uint8_t dev_addr, uint8_t instance, guncon2_gamepad_t const *pad, guncon2_gamepad_delta_t const *delta, uint8_t const *report, uint16_t len)
+{
+    (void)dev_addr; (void)instance; (void)delta; (void)report; (void)len;
+    print_pad(pad, sizeof(*pad));
+}
+
+void tuh_densha_pad_received_cb(uint8_t dev_addr, uint8_t instance, densha_gamepad_t const *pad, densha_gamepad_delta_t const *delta, uint8_t const *report, uint16_t len)
+{
+    (void)dev_addr; (void)instance; (void)delta; (void)report; (void)len;
+    print_pad(pad, sizeof(*pad));
+}
+
+// the trace may come from another address, everything goes to the mocked device
+static bool inject_sbc(uint8_t dev_addr, uint8_t instance, uint8_t ep_addr, xfer_result_t result, uint8_t const *data, uint16_t len)
+{
+    (void)dev_addr; (void)instance;
+    bool const ok = tuh_sbc_replay(1, 0, ep_addr, result, data, len);
+    failed += !ok;
+    return ok;
+}
+
+static bool inject_guncon2(uint8_t dev_addr, uint8_t instance, uint8_t ep_addr, xfer_result_t result, uint8_t const *data, uint16_t len)
+{
+    (void)dev_addr; (void)instance;
+    bool const ok = tuh_guncon2_replay(1, 0, ep_addr, result, data, len);
+    failed += !ok;
+    return ok;
+}
+
+static bool inject_densha(uint8_t dev_addr, uint8_t instance, uint8_t ep_addr, xfer_result_t result, uint8_t const *data, uint16_t len)
+{
+    (void)dev_addr; (void)instance;
+    bool const ok = tuh_densha_replay(1, 0, ep_addr, result, data, len);
+    failed += !ok;
+    return ok;
+}
+
+static uint8_t *read_file(char const *path, uint32_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+
+    uint8_t *buf = NULL;
+    uint32_t len = 0;
+    uint32_t cap = 0;
+    size_t n;
+    do
+    {
+        if (len == cap)
+        {
+            cap = cap ? 2 * cap : 65536;
+            buf = realloc(buf, cap);
+            assert(buf);
+        }
+        n = fread(buf + len, 1, cap - len, f);
+        len += (uint32_t)n;
+    } while (n);
+
+    fclose(f);
+    *size = len;
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s sbc|guncon2|densha trace.bin\n", argv[0]);
+        return 2;
+    }
+
+    uint32_t size;
+    uint8_t *trace = read_file(argv[2], &size);
+    if (!trace)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    mock_reset();
+    vendorh_trace_inject_t inject;
+    bool mounted;
+    if (strcmp(argv[1], "sbc") == 0)
+    {
+        sbch_init();
+        mounted = mock_mount(sbch_open, sbch_set_config, 1, 0x0A7B, 0xD000);
+        inject = inject_sbc;
+    }
+    else if (strcmp(argv[1], "guncon2") == 0)
+    {
+        guncon2h_init();
+        mounted = mock_mount(guncon2h_open, guncon2h_set_config, 1, 0x0B9A, 0x016A);
+        inject = inject_guncon2;
+    }
+    else if (strcmp(argv[1], "densha") == 0)
+    {
+        denshah_init();
+        mounted = mock_mount(denshah_open, denshah_set_config, 1, DENSHA_VID_TAITO, DENSHA_PID_PS2TYPE2);
+        inject = inject_densha;
+    }
+    else
+    {
+        fprintf(stderr, "unknown driver %s\n", argv[1]);
+        return 2;
+    }
+    assert(mounted);
+
+    uint32_t const records = vendorh_trace_replay(trace, size, inject, NULL);
+    printf("%u records, %u pads, %u failed transfers\n", (unsigned)records, (unsigned)pads, (unsigned)failed);
+
+    free(trace);
+    return 0;
+}
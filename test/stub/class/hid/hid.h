@@ -0,0 +1,9 @@
+#ifndef _TUSB_HID_H_
+#define _TUSB_HID_H_
+
+enum
+{
+    HID_REQ_CONTROL_SET_REPORT = 0x09
+};
+
+#endif /* _TUSB_HID_H_ */
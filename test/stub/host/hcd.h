@@ -0,0 +1,9 @@
+#ifndef _TUSB_HCD_H_
+#define _TUSB_HCD_H_
+
+#include "tusb_option.h"
+
+uint32_t hcd_frame_number(uint8_t rhport);
+bool hcd_edpt_clear_stall(uint8_t rhport, uint8_t dev_addr, uint8_t ep_addr);
+
+#endif /* _TUSB_HCD_H_ */
@@ -0,0 +1,31 @@
+#ifndef _TUSB_USBH_H_
+#define _TUSB_USBH_H_
+
+#include "tusb_option.h"
+
+struct tuh_xfer_s;
+typedef struct tuh_xfer_s tuh_xfer_t;
+
+typedef void (*tuh_xfer_cb_t)(tuh_xfer_t *xfer);
+
+struct tuh_xfer_s
+{
+    uint8_t daddr;
+    uint8_t ep_addr;
+    xfer_result_t result;
+    uint32_t actual_len;
+    union
+    {
+        tusb_control_request_t const *setup;
+        uint32_t buflen;
+    };
+    uint8_t *buffer;
+    tuh_xfer_cb_t complete_cb;
+    uintptr_t user_data;
+};
+
+bool tuh_control_xfer(tuh_xfer_t *xfer);
+bool tuh_vid_pid_get(uint8_t dev_addr, uint16_t *vid, uint16_t *pid);
+bool tuh_edpt_open(uint8_t dev_addr, tusb_desc_endpoint_t const *desc_ep);
+
+#endif /* _TUSB_USBH_H_ */
@@ -0,0 +1,13 @@
+#ifndef _TUSB_USBH_CLASSDRIVER_H_
+#define _TUSB_USBH_CLASSDRIVER_H_
+
+#include "host/usbh.h"
+
+bool usbh_edpt_claim(uint8_t dev_addr, uint8_t ep_addr);
+bool usbh_edpt_release(uint8_t dev_addr, uint8_t ep_addr);
+bool usbh_edpt_xfer(uint8_t dev_addr, uint8_t ep_addr, uint8_t *buffer, uint16_t total_bytes);
+bool usbh_edpt_busy(uint8_t dev_addr, uint8_t ep_addr);
+void usbh_driver_set_config_complete(uint8_t dev_addr, uint8_t itf_num);
+uint8_t usbh_get_rhport(uint8_t dev_addr);
+
+#endif /* _TUSB_USBH_CLASSDRIVER_H_ */
@@ -0,0 +1,12 @@
+// Host test configuration, driver options are passed with -D by the Makefile
+
+#ifndef _TUSB_CONFIG_H_
+#define _TUSB_CONFIG_H_
+
+#define CFG_TUH_DEVICE_MAX 4
+
+#define CFG_TUH_DENSHA  2
+#define CFG_TUH_GUNCON2 2
+#define CFG_TUH_SBC     2
+
+#endif /* _TUSB_CONFIG_H_ */
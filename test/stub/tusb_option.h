@@ -0,0 +1,111 @@
+// Stand-in for the parts of tinyusb the drivers use, enough to build them
+// on a PC against mock_usbh.c. Not a replacement for the real headers.
+
+#ifndef _TUSB_OPTION_H_
+#define _TUSB_OPTION_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "tusb_config.h"
+
+#define TUSB_OPT_HOST_ENABLED 1
+
+#define TU_ATTR_WEAK          __attribute__((weak))
+#define TU_ATTR_ALWAYS_INLINE __attribute__((always_inline))
+#define TU_ATTR_PACKED        __attribute__((packed))
+
+#define _TU_GET_3RD(a, b, c, ...) c
+
+#define _TU_VERIFY_1(_cond)      do { if (!(_cond)) return false; } while (0)
+#define _TU_VERIFY_2(_cond, _r)  do { if (!(_cond)) return _r; } while (0)
+#define TU_VERIFY(...)           _TU_GET_3RD(__VA_ARGS__, _TU_VERIFY_2, _TU_VERIFY_1, _)(__VA_ARGS__)
+
+#define _TU_ASSERT_1(_cond)      do { if (!(_cond)) { printf("ASSERT %s:%d\n", __FILE__, __LINE__); return false; } } while (0)
+#define _TU_ASSERT_2(_cond, _r)  do { if (!(_cond)) { printf("ASSERT %s:%d\n", __FILE__, __LINE__); return _r; } } while (0)
+#define TU_ASSERT(...)           _TU_GET_3RD(__VA_ARGS__, _TU_ASSERT_2, _TU_ASSERT_1, _)(__VA_ARGS__)
+
+#define TU_LOG1(...)
+#define TU_LOG2(...)
+#define TU_LOG2_MEM(...)
+
+#define TU_U16(_high, _low)  ((uint16_t)(((_high) << 8) | (_low)))
+#define TU_ARRAY_SIZE(_arr)  (sizeof(_arr) / sizeof(_arr[0]))
+#define TU_MIN(_x, _y)       (((_x) < (_y)) ? (_x) : (_y))
+#define TU_MAX(_x, _y)       (((_x) > (_y)) ? (_x) : (_y))
+#define TU_BIT(n)            (1UL << (n))
+#define TU_VERIFY_STATIC     _Static_assert
+
+static inline void tu_memclr(void *buffer, size_t size) { memset(buffer, 0, size); }
+static inline uint16_t tu_htole16(uint16_t value) { return value; }
+
+typedef enum
+{
+    XFER_RESULT_SUCCESS = 0,
+    XFER_RESULT_FAILED,
+    XFER_RESULT_STALLED,
+    XFER_RESULT_TIMEOUT,
+    XFER_RESULT_INVALID
+} xfer_result_t;
+
+enum { TUSB_DIR_OUT = 0, TUSB_DIR_IN = 1, TUSB_DIR_IN_MASK = 0x80 };
+enum { TUSB_DESC_DEVICE = 1, TUSB_DESC_CONFIGURATION = 2, TUSB_DESC_INTERFACE = 4, TUSB_DESC_ENDPOINT = 5 };
+enum { TUSB_REQ_TYPE_STANDARD = 0, TUSB_REQ_TYPE_CLASS, TUSB_REQ_TYPE_VENDOR };
+enum { TUSB_REQ_RCPT_DEVICE = 0, TUSB_REQ_RCPT_INTERFACE, TUSB_REQ_RCPT_ENDPOINT, TUSB_REQ_RCPT_OTHER };
+enum { TUSB_REQ_CLEAR_FEATURE = 1 };
+enum { TUSB_REQ_FEATURE_EDPT_HALT = 0 };
+
+typedef struct TU_ATTR_PACKED
+{
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bInterfaceNumber;
+    uint8_t bAlternateSetting;
+    uint8_t bNumEndpoints;
+    uint8_t bInterfaceClass;
+    uint8_t bInterfaceSubClass;
+    uint8_t bInterfaceProtocol;
+    uint8_t iInterface;
+} tusb_desc_interface_t;
+
+typedef struct TU_ATTR_PACKED
+{
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bEndpointAddress;
+    uint8_t bmAttributes;
+    uint16_t wMaxPacketSize;
+    uint8_t bInterval;
+} tusb_desc_endpoint_t;
+
+typedef struct TU_ATTR_PACKED
+{
+    union
+    {
+        struct TU_ATTR_PACKED
+        {
+            uint8_t recipient : 5;
+            uint8_t type : 2;
+            uint8_t direction : 1;
+        } bmRequestType_bit;
+        uint8_t bmRequestType;
+    };
+    uint8_t bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+} tusb_control_request_t;
+
+static inline uint8_t tu_desc_type(void const *desc) { return ((uint8_t const *)desc)[1]; }
+static inline uint8_t tu_desc_len(void const *desc) { return ((uint8_t const *)desc)[0]; }
+static inline uint8_t const *tu_desc_next(void const *desc) { return (uint8_t const *)desc + tu_desc_len(desc); }
+
+static inline uint8_t tu_edpt_dir(uint8_t addr) { return (addr & TUSB_DIR_IN_MASK) ? TUSB_DIR_IN : TUSB_DIR_OUT; }
+static inline uint8_t tu_edpt_number(uint8_t addr) { return (uint8_t)(addr & 0x7F); }
+static inline uint8_t tu_edpt_addr(uint8_t num, uint8_t dir) { return (uint8_t)(num | (dir ? TUSB_DIR_IN_MASK : 0)); }
+static inline uint16_t tu_edpt_packet_size(tusb_desc_endpoint_t const *desc_ep) { return desc_ep->wMaxPacketSize & 0x7FF; }
+
+#endif /* _TUSB_OPTION_H_ */
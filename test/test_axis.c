@@ -0,0 +1,194 @@
+// Axis calibration tables and auto calibration
+
+#include "mock_usbh.h"
+#include "sbc/sbc_host.h"
+#include "densha/densha_host.h"
+
+static void test_lut(void)
+{
+    static vendorh_axis_t axis;
+
+    vendorh_axis_cal_t cal = { .min = 10, .center = 128, .max = 240, .deadzone = 4, .flags = VENDORH_AXIS_BIPOLAR };
+    vendorh_axis_init(&axis, &cal);
+    assert(axis.lut[0] == -32767 && axis.lut[10] == -32767);
+    assert(axis.lut[124] == 0 && axis.lut[128] == 0 && axis.lut[132] == 0);
+    assert(axis.lut[133] > 0 && axis.lut[240] == 32767 && axis.lut[255] == 32767);
+
+    // the curve flattens the response near the center, ends about unchanged
+    int16_t const linear = axis.lut[186];
+    cal.curve = 255;
+    vendorh_axis_init(&axis, &cal);
+    assert(axis.lut[186] > 0 && axis.lut[186] < linear && axis.lut[240] == 32767);
+
+    cal = (vendorh_axis_cal_t){ .min = 0, .max = 255, .flags = VENDORH_AXIS_INVERT };
+    vendorh_axis_init(&axis, &cal);
+    assert(axis.lut[0] == 32767 && axis.lut[255] == 0);
+
+    // an inverted axis rests at max, the deadzone sits there too
+    cal.deadzone = 10;
+    vendorh_axis_init(&axis, &cal);
+    assert(axis.lut[255] == 0 && axis.lut[245] == 0 && axis.lut[244] > 0 && axis.lut[0] == 32767);
+
+    // bipolar inversion mirrors around the center
+    cal = (vendorh_axis_cal_t){ .min = 0, .center = 100, .max = 255, .flags = VENDORH_AXIS_BIPOLAR | VENDORH_AXIS_INVERT };
+    vendorh_axis_init(&axis, &cal);
+    assert(axis.lut[0] == 32767 && axis.lut[100] == 0 && axis.lut[255] == -32767 && axis.lut[50] > 16000);
+}
+
+static void sbc_pedal(uint8_t pedal)
+{
+    uint8_t report[26] = { 0 };
+    report[6] = 0x80;
+    report[9] = 255;
+    report[19] = pedal;
+    assert(tuh_sbc_receive_report(1, 0));
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+}
+
+static void test_sbc(void)
+{
+    mock_reset();
+    sbch_init();
+    assert(mock_mount(sbch_open, sbch_set_config, 1, 0x0A7B, 0xD000));
+    assert(tuh_sbc_axis_autocal(1, 0, SBC_AXIS_LEFT_PEDAL, true));
+    tuh_sbc_task(0);
+
+    uint8_t const pedals[] = { 40, 200, 120 };
+    for (unsigned i = 0; i < sizeof(pedals); i++)
+    {
+        sbc_pedal(pedals[i]);
+        tuh_sbc_task(0);
+    }
+
+    int16_t axes[SBC_AXIS_COUNT];
+    assert(tuh_sbc_get_axes(1, 0, axes));
+    assert(axes[SBC_AXIS_AIMING_X] == 32767);
+
+    vendorh_axis_cal_t cal;
+    assert(tuh_sbc_get_axis_cal(1, 0, SBC_AXIS_LEFT_PEDAL, &cal));
+    assert(cal.min == 40 && cal.max == 200);
+    assert(axes[SBC_AXIS_LEFT_PEDAL] > 0 && axes[SBC_AXIS_LEFT_PEDAL] < 32767);
+
+    // learning a wider range only marks the table, the task rebuilds it
+    sbc_pedal(20);
+    assert(tuh_sbc_get_axis_cal(1, 0, SBC_AXIS_LEFT_PEDAL, &cal) && cal.min == 20);
+    assert(tuh_sbc_get_axes(1, 0, axes) && axes[SBC_AXIS_LEFT_PEDAL] == 0);
+    sbc_pedal(40);
+    assert(tuh_sbc_get_axes(1, 0, axes) && axes[SBC_AXIS_LEFT_PEDAL] == 0);
+    tuh_sbc_task(0);
+    sbc_pedal(40);
+    assert(tuh_sbc_get_axes(1, 0, axes) && axes[SBC_AXIS_LEFT_PEDAL] > 0);
+
+    // a new calibration applies once the task ran
+    cal = (vendorh_axis_cal_t){ .min = 0, .max = 100 };
+    assert(tuh_sbc_set_axis_cal(1, 0, SBC_AXIS_LEFT_PEDAL, &cal));
+    sbc_pedal(120);
+    assert(tuh_sbc_get_axes(1, 0, axes) && axes[SBC_AXIS_LEFT_PEDAL] < 32767);
+    tuh_sbc_task(0);
+    assert(tuh_sbc_get_axis_cal(1, 0, SBC_AXIS_LEFT_PEDAL, &cal) && cal.min == 0 && cal.max == 100);
+    sbc_pedal(120);
+    assert(tuh_sbc_get_axes(1, 0, axes) && axes[SBC_AXIS_LEFT_PEDAL] == 32767);
+
+    // autocal no longer widens the range once it is turned off
+    assert(tuh_sbc_axis_autocal(1, 0, SBC_AXIS_LEFT_PEDAL, true));
+    assert(tuh_sbc_axis_autocal(1, 0, SBC_AXIS_LEFT_PEDAL, false));
+    tuh_sbc_task(0);
+    assert(tuh_sbc_get_axis_cal(1, 0, SBC_AXIS_LEFT_PEDAL, &cal));
+    uint8_t const max = cal.max;
+    sbc_pedal(max + 30);
+    assert(tuh_sbc_get_axis_cal(1, 0, SBC_AXIS_LEFT_PEDAL, &cal) && cal.max == max);
+
+    // nothing to change on a closed instance
+    sbch_close(1);
+    assert(!tuh_sbc_set_axis_cal(1, 0, SBC_AXIS_LEFT_PEDAL, &cal));
+    assert(!tuh_sbc_axis_autocal(1, 0, SBC_AXIS_LEFT_PEDAL, true));
+    assert(!tuh_sbc_get_axis_cal(1, 0, SBC_AXIS_LEFT_PEDAL, &cal));
+}
+
+static void test_densha(void)
+{
+    mock_reset();
+    denshah_init();
+    assert(mock_mount(denshah_open, denshah_set_config, 1, DENSHA_VID_TAITO, DENSHA_PID_PS2TYPE2));
+
+    // levers at rest: P0 and B0
+    uint8_t report[6] = { 1, 0x79, 0x81, 0x00, 8, 0 };
+    assert(tuh_densha_receive_report(1, 0));
+    assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+
+    int16_t axes[DENSHA_AXIS_COUNT];
+    assert(tuh_densha_get_axes(1, 0, axes));
+    assert(axes[DENSHA_AXIS_POWER] == 0 && axes[DENSHA_AXIS_BRAKE] == 0 && axes[DENSHA_AXIS_PEDAL] == 0);
+
+    // P5 and EB
+    report[1] = 0xB9;
+    report[2] = 0x00;
+    assert(tuh_densha_receive_report(1, 0));
+    assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+    assert(tuh_densha_get_axes(1, 0, axes));
+    assert(axes[DENSHA_AXIS_POWER] == 32767 && axes[DENSHA_AXIS_BRAKE] == 32767);
+
+    // notches in between increase with the lever
+    report[1] = 0x94; // B3
+    report[2] = 0x54; // P3
+    assert(tuh_densha_receive_report(1, 0));
+    assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+    assert(tuh_densha_get_axes(1, 0, axes));
+    assert(axes[DENSHA_AXIS_POWER] > 0 && axes[DENSHA_AXIS_POWER] < 32767);
+    assert(axes[DENSHA_AXIS_BRAKE] > 0 && axes[DENSHA_AXIS_BRAKE] < 32767);
+    int16_t const linear = axes[DENSHA_AXIS_POWER];
+
+    // deadzone and curve start from P0, not from P5
+    vendorh_axis_cal_t cal;
+    assert(tuh_densha_get_axis_cal(1, 0, DENSHA_AXIS_POWER, &cal));
+    cal.deadzone = 8;
+    cal.curve = 255;
+    assert(tuh_densha_set_axis_cal(1, 0, DENSHA_AXIS_POWER, &cal));
+    tuh_densha_task(0);
+
+    uint8_t const power[] = { 0x81, 0x81 - 8, 0x54, 0x00 };
+    int16_t value[sizeof(power)];
+    for (unsigned i = 0; i < sizeof(power); i++)
+    {
+        report[2] = power[i];
+        assert(tuh_densha_receive_report(1, 0));
+        assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+        assert(tuh_densha_get_axes(1, 0, axes));
+        value[i] = axes[DENSHA_AXIS_POWER];
+    }
+    assert(value[0] == 0 && value[1] == 0 && value[3] == 32767);
+    assert(value[2] > 0 && value[2] < linear / 4);
+}
+
+static void test_shinkansen(void)
+{
+    mock_reset();
+    denshah_init();
+    assert(mock_mount(denshah_open, denshah_set_config, 1, DENSHA_VID_TAITO, DENSHA_PID_PS2SHINKANSEN));
+
+    // both levers rise from their rest code, P0 0x12 and B0 0x1C
+    uint8_t const power[] = { 0x12, 0xFB };
+    uint8_t const brake[] = { 0x1C, 0xFB };
+    int16_t const expect[] = { 0, 32767 };
+    for (unsigned i = 0; i < sizeof(power); i++)
+    {
+        uint8_t const report[6] = { brake[i], power[i], 0, 8, 0, 0 };
+        assert(tuh_densha_receive_report(1, 0));
+        assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+
+        int16_t axes[DENSHA_AXIS_COUNT];
+        assert(tuh_densha_get_axes(1, 0, axes));
+        assert(axes[DENSHA_AXIS_POWER] == expect[i] && axes[DENSHA_AXIS_BRAKE] == expect[i]);
+    }
+}
+
+int main(void)
+{
+    test_lut();
+    test_sbc();
+    test_densha();
+    test_shinkansen();
+
+    printf("axis ok\n");
+    return 0;
+}
@@ -0,0 +1,253 @@
+// Densha controller: model match, report decode and the EP0 command queue
+
+#include "mock_usbh.h"
+#include "densha/densha_host.h"
+
+static int sent;
+static int failed;
+static int outputs_done;
+
+void tuh_densha_report_sent_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len)
+{
+    (void)dev_addr; (void)instance; (void)report; (void)len;
+    sent++;
+}
+
+void tuh_densha_report_failed_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len, xfer_result_t result)
+{
+    (void)dev_addr; (void)instance; (void)report; (void)len;
+    assert(result == XFER_RESULT_STALLED);
+    failed++;
+}
+
+static xfer_result_t outputs_result;
+static densha_type_t mounted_type;
+static const denshah_interface_t *mounted_itf;
+
+void tuh_densha_mount_cb(uint8_t dev_addr, uint8_t instance, const denshah_interface_t *densha_itf)
+{
+    (void)dev_addr; (void)instance;
+    mounted_type = densha_itf->type;
+    mounted_itf = densha_itf;
+}
+
+void tuh_densha_outputs_sent_cb(uint8_t dev_addr, uint8_t instance, densha_outputs_t const *outputs, xfer_result_t result)
+{
+    (void)dev_addr; (void)instance; (void)outputs;
+    outputs_result = result;
+    outputs_done++;
+}
+
+static void mount(void)
+{
+    mock_reset();
+    denshah_init();
+    sent = failed = outputs_done = 0;
+    assert(mock_mount(denshah_open, denshah_set_config, 1, DENSHA_VID_TAITO, DENSHA_PID_PS2TYPE2));
+}
+
+static void test_match(void)
+{
+    mock_reset();
+    denshah_init();
+    assert(!mock_mount(denshah_open, denshah_set_config, 1, DENSHA_VID_TAITO, 0x1234));
+    mount();
+    assert(mounted_type == TAITO_DENSYA_CON_T01);
+}
+
+static void test_decode(void)
+{
+    mount();
+
+    // brake, power, pedal, dpad, buttons
+    uint8_t const report[6] = { 1, 0x79, 0x81, 0x20, 0x08, 0x03 };
+    uint32_t const seq = mounted_itf->base.pad_seq;
+    assert(tuh_densha_receive_report(1, 0));
+    assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+
+    // pad, report time, axes and notch go out in a single write section
+    assert(mounted_itf->base.pad_seq == seq + 2);
+
+    densha_gamepad_t pad;
+    assert(tuh_densha_get_state(1, 0, &pad));
+    assert(pad.bBrake == 0x79 && pad.bPower == 0x81 && pad.bPedal == 0x20 && pad.bDpad == 0x08 && pad.bButtons == 0x03);
+
+    // wrong report id is dropped
+    uint8_t const bad[6] = { 2, 0x80, 0x00, 0, 0, 0 };
+    assert(tuh_densha_receive_report(1, 0));
+    assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, bad, sizeof(bad), XFER_RESULT_SUCCESS));
+    assert(tuh_densha_get_state(1, 0, &pad) && pad.bBrake == 0x79);
+}
+
+static void test_commands(void)
+{
+    mount();
+
+    // one command at a time on EP0, newest state per function wins
+    assert(tuh_densha_set_lamp(1, 0, true));
+    assert(mock_ctrl_count == 1);
+    assert(mock_ctrl_req.bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR && mock_ctrl_req.wValue == 0x0201);
+    assert(mock_ctrl_buf[0] == DOOR_LAMP && mock_ctrl_buf[1] == 1);
+    assert(tuh_densha_set_rumble_power_handle(1, 0, true));
+    assert(tuh_densha_set_rumble_power_handle(1, 0, false));
+    assert(tuh_densha_set_rumble_brake_handle(1, 0, true));
+    assert(mock_ctrl_count == 1);
+
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(sent == 1 && mock_ctrl_count == 2 && mock_ctrl_buf[0] == LEFT_RUMBLE && mock_ctrl_buf[1] == 0);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(sent == 2 && mock_ctrl_count == 3 && mock_ctrl_buf[0] == RIGHT_RUMBLE && mock_ctrl_buf[1] == 1);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(sent == 3 && !mock_ctrl_pending());
+
+    // the state the device already has is not sent again
+    assert(tuh_densha_set_lamp(1, 0, true));
+    assert(mock_ctrl_count == 3);
+
+    // EP0 busy: the command stays pending and goes out with the next IN report
+    mock_ctrl_reject = true;
+    assert(tuh_densha_set_lamp(1, 0, false));
+    mock_ctrl_reject = false;
+    assert(mock_ctrl_count == 3 && tuh_densha_outputs_busy(1, 0));
+
+    uint8_t const report[6] = { 1, 0x79, 0x81, 0, 8, 0 };
+    assert(tuh_densha_receive_report(1, 0));
+    assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+    assert(mock_ctrl_count == 4 && mock_ctrl_buf[0] == DOOR_LAMP && mock_ctrl_buf[1] == 0);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(!tuh_densha_outputs_busy(1, 0));
+
+    // pending commands go out oldest first, not by function number
+    assert(tuh_densha_set_lamp(1, 0, true));
+    assert(tuh_densha_set_rumble_brake_handle(1, 0, false));
+    assert(tuh_densha_set_rumble_power_handle(1, 0, true));
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(mock_ctrl_buf[0] == RIGHT_RUMBLE && mock_ctrl_buf[1] == 0);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(mock_ctrl_buf[0] == LEFT_RUMBLE && mock_ctrl_buf[1] == 1);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(!tuh_densha_outputs_busy(1, 0));
+}
+
+static void test_retry(void)
+{
+    mount();
+
+    // a failed command is sent again as is
+    assert(tuh_densha_set_lamp(1, 0, true));
+    assert(mock_ctrl_complete(XFER_RESULT_STALLED));
+    assert(mock_ctrl_count == 2 && mock_ctrl_buf[0] == DOOR_LAMP && mock_ctrl_buf[1] == 1);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(sent == 1 && failed == 0 && !tuh_densha_outputs_busy(1, 0));
+
+    // retries exhausted: reported once, the next request sends the state again
+    assert(tuh_densha_set_lamp(1, 0, false));
+    for (int i = 0; i <= CFG_TUH_VENDORH_CTRL_RETRIES; i++)
+    {
+        assert(failed == 0 && mock_ctrl_complete(XFER_RESULT_STALLED));
+    }
+    assert(mock_ctrl_count == 3 + CFG_TUH_VENDORH_CTRL_RETRIES && failed == 1 && !mock_ctrl_pending());
+    assert(tuh_densha_set_lamp(1, 0, false));
+    assert(mock_ctrl_count == 4 + CFG_TUH_VENDORH_CTRL_RETRIES && mock_ctrl_buf[1] == 0);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(sent == 2 && failed == 1);
+
+    // EP0 busy on the resend: reported right away
+    assert(tuh_densha_set_lamp(1, 0, true));
+    mock_ctrl_reject = true;
+    assert(mock_ctrl_complete(XFER_RESULT_STALLED));
+    mock_ctrl_reject = false;
+    assert(failed == 2 && !tuh_densha_outputs_busy(1, 0));
+}
+
+static void test_outputs(void)
+{
+    mount();
+
+    // changed functions go out back to back, one callback for the batch
+    densha_outputs_t outputs = { .power_rumble = true, .brake_rumble = false, .door_lamp = true };
+    assert(tuh_densha_set_outputs(1, 0, &outputs));
+    assert(mock_ctrl_count == 1 && tuh_densha_outputs_busy(1, 0));
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(mock_ctrl_count == 2 && outputs_done == 0);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(mock_ctrl_count == 3 && outputs_done == 0);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(outputs_done == 1 && !tuh_densha_outputs_busy(1, 0));
+
+    densha_outputs_t got;
+    assert(tuh_densha_get_outputs(1, 0, &got) && got.power_rumble && !got.brake_rumble && got.door_lamp);
+
+    // only the lamp changed
+    outputs.door_lamp = false;
+    assert(tuh_densha_set_outputs(1, 0, &outputs));
+    assert(mock_ctrl_count == 4);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(outputs_done == 2);
+
+    // nothing changed: done right away
+    assert(tuh_densha_set_outputs(1, 0, &outputs));
+    assert(mock_ctrl_count == 4 && outputs_done == 3 && outputs_result == XFER_RESULT_SUCCESS);
+
+    // one output failing after its retries fails the batch, the rest still goes out
+    outputs.power_rumble = false;
+    outputs.door_lamp = true;
+    assert(tuh_densha_set_outputs(1, 0, &outputs));
+    for (int i = 0; i <= CFG_TUH_VENDORH_CTRL_RETRIES; i++)
+    {
+        assert(mock_ctrl_complete(XFER_RESULT_STALLED));
+    }
+    assert(failed == 1 && outputs_done == 3 && mock_ctrl_buf[0] == DOOR_LAMP);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(outputs_done == 4 && outputs_result == XFER_RESULT_STALLED);
+
+    // the next batch starts clean and sends the failed output again
+    assert(tuh_densha_set_outputs(1, 0, &outputs));
+    assert(mock_ctrl_buf[0] == LEFT_RUMBLE && mock_ctrl_buf[1] == 0);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(outputs_done == 5 && outputs_result == XFER_RESULT_SUCCESS);
+}
+
+static void test_shinkansen(void)
+{
+    mock_reset();
+    denshah_init();
+    assert(mock_mount(denshah_open, denshah_set_config, 1, DENSHA_VID_TAITO, DENSHA_PID_PS2SHINKANSEN));
+    assert(mounted_type == TAITO_DENSYA_SHINKANSEN);
+
+    // brake, power, horn, dpad, buttons: D and START pressed
+    uint8_t const report[6] = { 0x38, 0x24, 0xFF, 0x08, 0x21, 0 };
+    assert(tuh_densha_receive_report(1, 0));
+    assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+
+    densha_gamepad_t pad;
+    assert(tuh_densha_get_state(1, 0, &pad));
+    assert(pad.bBrake == 0x38 && pad.bPower == 0x24 && pad.bPedal == 0xFF && pad.bDpad == 0x08);
+    assert(pad.bButtons == (DENSHA_GAMEPAD_D | DENSHA_GAMEPAD_START));
+
+    // B and A sit in bits 2 and 3, C in bit 1
+    uint8_t const buttons[6] = { 0x38, 0x24, 0, 0x08, 0x0E, 0 };
+    assert(tuh_densha_receive_report(1, 0));
+    assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, buttons, sizeof(buttons), XFER_RESULT_SUCCESS));
+    assert(tuh_densha_get_state(1, 0, &pad));
+    assert(pad.bButtons == (DENSHA_GAMEPAD_A | DENSHA_GAMEPAD_B | DENSHA_GAMEPAD_C));
+
+    // its outputs use another report, the Type 2 commands are not sent to it
+    densha_outputs_t const outputs = { .door_lamp = true };
+    assert(!tuh_densha_set_lamp(1, 0, true));
+    assert(!tuh_densha_set_outputs(1, 0, &outputs));
+    assert(mock_ctrl_count == 0);
+}
+
+int main(void)
+{
+    test_match();
+    test_decode();
+    test_shinkansen();
+    test_commands();
+    test_retry();
+    test_outputs();
+
+    printf("densha ok\n");
+    return 0;
+}
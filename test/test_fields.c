@@ -0,0 +1,134 @@
+// Decoded pads of random valid reports against a reference decode written
+// from the report layouts, for the field table of every driver
+
+#include <stdlib.h>
+
+#include "mock_usbh.h"
+#include "sbc/sbc_host.h"
+#include "guncon2/guncon2_host.h"
+#include "densha/densha_host.h"
+
+enum { ROUNDS = 4096 };
+
+static void random_report(uint8_t *report, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++)
+        report[i] = (uint8_t)rand();
+}
+
+static void test_sbc(void)
+{
+    mock_reset();
+    sbch_init();
+    assert(mock_mount(sbch_open, sbch_set_config, 1, 0x0A7B, 0xD000));
+
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        uint8_t r[26];
+        random_report(r, sizeof(r));
+        r[6] |= 0x80;
+        r[7] = 0;
+        r[24] &= 0x0F;
+
+        assert(tuh_sbc_receive_report(1, 0));
+        assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, r, sizeof(r), XFER_RESULT_SUCCESS));
+
+        sbc_gamepad_t pad;
+        assert(tuh_sbc_get_state(1, 0, &pad));
+        assert(pad.bButtons == ((uint64_t)(r[6] & 0x7F) << 32 | (uint64_t)r[5] << 24 | (uint64_t)r[4] << 16 | (uint64_t)r[3] << 8 | r[2]));
+        assert(pad.bAimingX == r[9] && pad.bAimingY == r[11] && pad.bRotationLever == r[13]);
+        assert(pad.bSightChangeX == r[15] && pad.bSightChangeY == r[17]);
+        assert(pad.bLeftPedal == r[19] && pad.bMiddlePedal == r[21] && pad.bRightPedal == r[23]);
+        assert(pad.bTunerDial == (r[24] & 0x0F) && pad.bGearLever == r[25]);
+    }
+}
+
+static void test_guncon2(void)
+{
+    mock_reset();
+    guncon2h_init();
+    assert(mock_mount(guncon2h_open, guncon2h_set_config, 1, 0x0B9A, 0x016A));
+
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        uint8_t r[6];
+        random_report(r, sizeof(r));
+        r[3] &= 0x03; // keep the coordinates around the screen window
+        r[5] = 0;
+
+        assert(tuh_guncon2_receive_report(1, 0));
+        assert(mock_complete(guncon2h_xfer_cb, 1, MOCK_EP_IN, r, sizeof(r), XFER_RESULT_SUCCESS));
+
+        uint16_t const x = (uint16_t)(r[3] << 8 | r[2]);
+        uint16_t const y = (uint16_t)(r[5] << 8 | r[4]);
+        bool const offscreen = x < CFG_TUH_GUNCON2_X_MIN || x > CFG_TUH_GUNCON2_X_MAX ||
+                               y < CFG_TUH_GUNCON2_Y_MIN || y > CFG_TUH_GUNCON2_Y_MAX;
+
+        guncon2_gamepad_t pad;
+        assert(tuh_guncon2_get_state(1, 0, &pad));
+        assert(pad.bButtons == (((~r[1] >> 2) & 0x38) | ((~r[0] >> 1) & 0x07)));
+        assert(pad.bDpad == ((~r[0] >> 4) & 0x0F));
+        assert(pad.wGunX == x && pad.wGunY == y);
+        assert(pad.bFlags == (offscreen ? GUNCON2_FLAG_OFFSCREEN : 0));
+    }
+}
+
+static void test_densha(void)
+{
+    mock_reset();
+    denshah_init();
+    assert(mock_mount(denshah_open, denshah_set_config, 1, DENSHA_VID_TAITO, DENSHA_PID_PS2TYPE2));
+
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        uint8_t r[6];
+        random_report(r, sizeof(r));
+        r[0] = 1;
+        r[1] |= 1;
+
+        assert(tuh_densha_receive_report(1, 0));
+        assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, r, sizeof(r), XFER_RESULT_SUCCESS));
+
+        densha_gamepad_t pad;
+        assert(tuh_densha_get_state(1, 0, &pad));
+        assert(pad.bBrake == r[1] && pad.bPower == r[2] && pad.bPedal == r[3]);
+        assert(pad.bDpad == r[4] && pad.bButtons == r[5]);
+    }
+}
+
+static void test_shinkansen(void)
+{
+    mock_reset();
+    denshah_init();
+    assert(mock_mount(denshah_open, denshah_set_config, 1, DENSHA_VID_TAITO, DENSHA_PID_PS2SHINKANSEN));
+
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        uint8_t r[6];
+        random_report(r, sizeof(r));
+
+        assert(tuh_densha_receive_report(1, 0));
+        assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, r, sizeof(r), XFER_RESULT_SUCCESS));
+
+        // D C B A SELECT START on the wire, B A C D SELECT START in the pad
+        uint8_t const b = r[4];
+        uint8_t const buttons = (uint8_t)(((b >> 2) & 0x03) | ((b >> 1) & 1) << 2 | (b & 1) << 3 | (b & 0x30));
+
+        densha_gamepad_t pad;
+        assert(tuh_densha_get_state(1, 0, &pad));
+        assert(pad.bBrake == r[0] && pad.bPower == r[1] && pad.bPedal == r[2]);
+        assert(pad.bDpad == r[3] && pad.bButtons == buttons);
+    }
+}
+
+int main(void)
+{
+    srand(1);
+    test_sbc();
+    test_guncon2();
+    test_densha();
+    test_shinkansen();
+
+    printf("fields ok\n");
+    return 0;
+}
@@ -0,0 +1,63 @@
+// GunCon2 off-screen flag and the alpha-beta coordinate filter
+
+#include "mock_usbh.h"
+#include "guncon2/guncon2_host.h"
+
+static guncon2_gamepad_t send(uint16_t x, uint16_t y)
+{
+    uint8_t report[6] = { 0xFF, 0xFF, (uint8_t)(x & 0xFF), (uint8_t)(x >> 8), (uint8_t)(y & 0xFF), (uint8_t)(y >> 8) };
+
+    assert(tuh_guncon2_receive_report(1, 0));
+    assert(mock_complete(guncon2h_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+
+    guncon2_gamepad_t pad;
+    assert(tuh_guncon2_get_state(1, 0, &pad));
+    return pad;
+}
+
+int main(void)
+{
+    mock_reset();
+    guncon2h_init();
+    assert(mock_mount(guncon2h_open, guncon2h_set_config, 1, 0x0B9A, 0x016A));
+
+    // default gains: a step is followed part of the way
+    assert(send(300, 100).wGunX == 300);
+    guncon2_gamepad_t pad = send(400, 100);
+    assert(pad.wGunX > 300 && pad.wGunX < 400 && pad.wGunY == 100);
+    for (int i = 0; i < 30; i++)
+        pad = send(400, 100);
+    assert(pad.wGunX >= 399 && pad.wGunX <= 401);
+
+    // off screen: passed through and flagged, the filter restarts after it
+    pad = send(10, 100);
+    assert(pad.wGunX == 10 && (pad.bFlags & GUNCON2_FLAG_OFFSCREEN));
+    assert(send(600, 200).wGunX == 600);
+
+    // pass-through gains
+    guncon2_filter_config_t const raw = { .alpha = 256, .beta = 0, .predict_us = 0 };
+    assert(tuh_guncon2_set_filter(1, 0, &raw));
+    assert(send(300, 100).wGunX == 300);
+    assert(send(500, 150).wGunX == 500);
+
+    // prediction runs ahead of a steady motion
+    guncon2_filter_config_t const predict = { .alpha = 256, .beta = 64, .predict_us = CFG_TUH_GUNCON2_FRAME_US };
+    assert(tuh_guncon2_set_filter(1, 0, &predict));
+    for (uint16_t x = 200; x < 400; x += 10)
+        pad = send(x, 100);
+    assert(pad.wGunX > 390);
+
+    // gains above 1 are refused, the previous filter stays
+    guncon2_filter_config_t const fast = { .alpha = 257, .beta = 0 };
+    guncon2_filter_config_t const jumpy = { .alpha = 256, .beta = 4096 };
+    assert(!tuh_guncon2_set_filter(1, 0, &fast));
+    assert(!tuh_guncon2_set_filter(1, 0, &jumpy));
+    assert(send(400, 100).wGunX > 400);
+
+    // not mounted anymore
+    guncon2h_close(1);
+    assert(!tuh_guncon2_set_filter(1, 0, &raw));
+
+    printf("filter ok\n");
+    return 0;
+}
@@ -0,0 +1,88 @@
+// GunCon2 report decoding, config report queue and calibration
+
+#include "mock_usbh.h"
+#include "class/hid/hid.h"
+#include "guncon2/guncon2_host.h"
+
+static int failed;
+
+void tuh_guncon2_report_failed_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len, xfer_result_t result)
+{
+    (void)dev_addr; (void)instance; (void)len;
+    assert(report[5] == 1 && result == XFER_RESULT_FAILED);
+    failed++;
+}
+
+static void send(uint8_t b0, uint8_t b1, uint16_t x, uint16_t y)
+{
+    uint8_t report[6] = { b0, b1, (uint8_t)(x & 0xFF), (uint8_t)(x >> 8), (uint8_t)(y & 0xFF), (uint8_t)(y >> 8) };
+
+    assert(tuh_guncon2_receive_report(1, 0));
+    assert(mock_complete(guncon2h_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+}
+
+static void test_report(void)
+{
+    guncon2_gamepad_t pad;
+
+    // active low: trigger is bit 5 of byte 1, dpad up bit 4 of byte 0
+    send((uint8_t)~0x10, (uint8_t)~0x20, 400, 120);
+    assert(tuh_guncon2_get_state(1, 0, &pad));
+    assert(pad.bButtons == GUNCON2_GAMEPAD_TRIGGER && pad.bDpad == GUNCON2_GAMEPAD_DPAD_UP);
+    assert(pad.wGunX == 400 && pad.wGunY == 120 && pad.bFlags == 0);
+
+    send(0xFF, 0xFF, 0, 0);
+    assert(tuh_guncon2_get_state(1, 0, &pad) && pad.bButtons == 0 && (pad.bFlags & GUNCON2_FLAG_OFFSCREEN));
+}
+
+static void test_config(void)
+{
+    // 60 Hz mode is sent on mount
+    assert(mock_ctrl_count == 1 && mock_ctrl_buf[5] == 1);
+    assert(mock_ctrl_req.bRequest == HID_REQ_CONTROL_SET_REPORT && mock_ctrl_req.wLength == 6);
+
+    guncon2_point_t const samples[4] = { { 100, 30 }, { 700, 30 }, { 100, 230 }, { 700, 230 } };
+    guncon2_point_t const targets[4] = { { 90, 40 }, { 690, 40 }, { 90, 240 }, { 690, 240 } };
+    assert(tuh_guncon2_calibrate(1, 0, samples, targets, 4));
+
+    // waits for EP0, then goes out in one transfer
+    assert(mock_ctrl_count == 1);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(mock_ctrl_count == 2);
+    assert(mock_ctrl_buf[0] == 0xF6 && mock_ctrl_buf[1] == 0xFF && mock_ctrl_buf[2] == 10 && mock_ctrl_buf[3] == 0 && mock_ctrl_buf[5] == 1);
+
+    guncon2_config_t config;
+    assert(tuh_guncon2_get_config(1, 0, &config));
+    assert(config.x_offset == -10 && config.y_offset == 10 && config.mode_60hz);
+
+    // newest report wins while EP0 is busy
+    assert(tuh_guncon2_set_60hz(1, 0, false));
+    assert(tuh_guncon2_set_60hz(1, 0, true));
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(mock_ctrl_count == 3 && mock_ctrl_buf[5] == 1);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(mock_ctrl_count == 3);
+
+    // a failed report is sent again before it is reported
+    assert(tuh_guncon2_set_60hz(1, 0, true));
+    for (int i = 0; i <= CFG_TUH_VENDORH_CTRL_RETRIES; i++)
+    {
+        assert(failed == 0 && mock_ctrl_count == 4 + i && mock_ctrl_buf[5] == 1);
+        assert(mock_ctrl_complete(XFER_RESULT_FAILED));
+    }
+    assert(failed == 1 && !mock_ctrl_pending());
+}
+
+int main(void)
+{
+    mock_reset();
+    guncon2h_init();
+    assert(!mock_mount(guncon2h_open, guncon2h_set_config, 1, 0x1234, 0x5678));
+    assert(mock_mount(guncon2h_open, guncon2h_set_config, 1, 0x0B9A, 0x016A));
+
+    test_config();
+    test_report();
+
+    printf("guncon2 ok\n");
+    return 0;
+}
@@ -0,0 +1,68 @@
+// Densha lever codes decoded into notches
+
+#include "mock_usbh.h"
+#include "densha/densha_host.h"
+
+static int events;
+static densha_notch_t last;
+
+void tuh_densha_notch_cb(uint8_t dev_addr, uint8_t instance, densha_notch_t const *notch)
+{
+    (void)dev_addr; (void)instance;
+    events++;
+    last = *notch;
+}
+
+static void send(uint8_t brake, uint8_t power)
+{
+    uint8_t const report[6] = { 1, brake, power, 0, 8, 0 };
+    assert(tuh_densha_receive_report(1, 0));
+    assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+}
+
+// no report id, brake and power come first
+static void send_shinkansen(uint8_t brake, uint8_t power)
+{
+    uint8_t const report[6] = { brake, power, 0, 8, 0, 0 };
+    assert(tuh_densha_receive_report(1, 0));
+    assert(mock_complete(denshah_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+}
+
+int main(void)
+{
+    mock_reset();
+    denshah_init();
+    assert(mock_mount(denshah_open, denshah_set_config, 1, DENSHA_VID_TAITO, DENSHA_PID_PS2TYPE2));
+
+    densha_notch_t notch;
+
+    send(0x79, 0x81); // B0 P0 is the initial state
+    assert(events == 0);
+    send(0x79, 0x70); // power lever between P0 and P1
+    assert(events == 0);
+    assert(tuh_densha_get_notch(1, 0, &notch) && notch.flags == DENSHA_NOTCH_POWER_TRANSITION && notch.power == 0);
+    send(0x79, 0x6D);
+    assert(events == 1 && last.power == 1 && last.flags == 0);
+    send(0x79, 0x6D);
+    assert(events == 1);
+    send(0xB5, 0x00);
+    assert(events == 2 && last.power == 5 && last.brake == 8);
+    send(0xB9, 0x00);
+    assert(events == 3 && last.brake == DENSHA_BRAKE_EB && last.flags == DENSHA_NOTCH_EMERGENCY);
+
+    // the Shinkansen controller has its own codes, P13 and B7 before EB
+    denshah_close(1);
+    assert(mock_mount(denshah_open, denshah_set_config, 1, DENSHA_VID_TAITO, DENSHA_PID_PS2SHINKANSEN));
+    events = 0;
+    send_shinkansen(0x1C, 0x12);
+    assert(tuh_densha_get_notch(1, 0, &notch) && notch.power == 0 && notch.brake == 0 && notch.flags == 0);
+    send_shinkansen(0x1C, 0x90);
+    assert(events == 1 && last.power == 7);
+    send_shinkansen(0xDF, 0xFB);
+    assert(events == 2 && last.power == 13 && last.brake == 7 && last.flags == 0);
+    send_shinkansen(0xFB, 0xFB);
+    assert(events == 3 && last.brake == DENSHA_BRAKE_EB && last.flags == DENSHA_NOTCH_EMERGENCY);
+
+    printf("notch ok\n");
+    return 0;
+}
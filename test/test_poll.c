@@ -0,0 +1,113 @@
+// Self re-arming polling, double buffered IN reports, change detection,
+// the ring of decoded pads and report timestamps (SBC)
+
+#include "mock_usbh.h"
+#include "sbc/sbc_host.h"
+
+static uint32_t now_us;
+static int reports;
+static int pads;
+static bool rearmed_first;
+static sbc_gamepad_delta_t last_delta;
+
+uint32_t tuh_sbc_time_us_cb(void)
+{
+    return now_us;
+}
+
+void tuh_sbc_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len)
+{
+    (void)dev_addr; (void)instance; (void)report; (void)len;
+    reports++;
+}
+
+void tuh_sbc_pad_received_cb(uint8_t dev_addr, uint8_t instance, sbc_gamepad_t const *pad, sbc_gamepad_delta_t const *delta, uint8_t const *report, uint16_t len)
+{
+    (void)instance; (void)pad; (void)len;
+    pads++;
+    last_delta = *delta;
+
+    // the next transfer is already queued, into the other buffer
+    rearmed_first = mock_edpt_busy(dev_addr, MOCK_EP_IN) && mock_edpt_buf(dev_addr, MOCK_EP_IN) != report;
+}
+
+static void send(uint8_t buttons, uint8_t aim)
+{
+    uint8_t report[26] = { 0 };
+    report[2] = buttons;
+    report[6] = 0x80;
+    report[9] = aim;
+
+    now_us += 1000;
+    mock_frame++;
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+}
+
+int main(void)
+{
+    mock_reset();
+    sbch_init();
+    assert(mock_mount(sbch_open, sbch_set_config, 1, 0x0A7B, 0xD000));
+
+    assert(tuh_sbc_start_polling(1, 0));
+    assert(mock_xfers_in == 1);
+    // already armed, not queued twice
+    assert(tuh_sbc_start_polling(1, 0));
+    assert(mock_xfers_in == 1);
+
+    send(0x01, 10);
+    assert(mock_xfers_in == 2 && rearmed_first);
+    assert(reports == 1 && pads == 1);
+    assert(last_delta.changed == (SBC_FIELD_BUTTONS | SBC_FIELD_AIMING_X) && last_delta.pressed == 0x01);
+
+    // unchanged pad: no callback
+    send(0x01, 10);
+    assert(reports == 1 && pads == 1);
+
+    send(0x00, 10);
+    assert(pads == 2 && last_delta.changed == SBC_FIELD_BUTTONS && last_delta.released == 0x01);
+
+    vendorh_report_time_t report_time;
+    assert(tuh_sbc_get_report_time(1, 0, &report_time));
+    assert(report_time.time_us == 3000 && report_time.frame == 3);
+
+    // ring: every decoded report, changed or not
+    sbc_gamepad_entry_t entry;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        assert(tuh_sbc_ring_pop(1, 0, &entry));
+        assert(entry.seq == i && entry.timestamp_us == 1000 * (i + 1) && entry.frame == i + 1);
+    }
+    assert(entry.pad.bButtons == 0);
+    assert(!tuh_sbc_ring_pop(1, 0, &entry));
+
+    // overflow drops new entries, the seq gap shows it
+    for (int i = 0; i < CFG_TUH_SBC_RING_SIZE + 2; i++)
+        send((uint8_t)i, 20);
+    for (int i = 0; i < CFG_TUH_SBC_RING_SIZE; i++)
+        assert(tuh_sbc_ring_pop(1, 0, &entry));
+    send(0, 30);
+    assert(tuh_sbc_ring_pop(1, 0, &entry) && entry.seq == 3 + CFG_TUH_SBC_RING_SIZE + 2);
+
+    tuh_sbc_stop_polling(1, 0);
+    int const armed = mock_xfers_in;
+    send(0x02, 40);
+    assert(mock_xfers_in == armed && !mock_edpt_busy(1, MOCK_EP_IN));
+    assert(!tuh_sbc_is_polling(1, 0));
+
+    // a re-arm that fails ends polling instead of leaving it on with nothing queued
+    assert(tuh_sbc_start_polling(1, 0) && tuh_sbc_is_polling(1, 0));
+    mock_xfer_reject = true;
+    send(0x03, 40);
+    mock_xfer_reject = false;
+    assert(!tuh_sbc_is_polling(1, 0) && !mock_edpt_busy(1, MOCK_EP_IN));
+    assert(tuh_sbc_start_polling(1, 0) && mock_edpt_busy(1, MOCK_EP_IN));
+
+    // so does an IN error without recovery
+    assert(!mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, NULL, 0, XFER_RESULT_STALLED));
+    assert(!tuh_sbc_is_polling(1, 0));
+    assert(tuh_sbc_start_polling(1, 0) && mock_edpt_busy(1, MOCK_EP_IN));
+
+    printf("poll ok\n");
+    return 0;
+}
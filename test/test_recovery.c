@@ -0,0 +1,85 @@
+// IN transfer recovery: halt clearing, backoff and link state
+
+#include "mock_usbh.h"
+#include "sbc/sbc_host.h"
+
+static int links[2];
+
+void tuh_sbc_link_cb(uint8_t dev_addr, uint8_t instance, vendorh_link_t link)
+{
+    (void)dev_addr; (void)instance;
+    links[link]++;
+}
+
+int main(void)
+{
+    mock_reset();
+    sbch_init();
+    assert(mock_mount(sbch_open, sbch_set_config, 1, 0x0A7B, 0xD000));
+
+    // a stall clears the halt after the first backoff, then re-arms
+    assert(tuh_sbc_receive_report(1, 0));
+    assert(mock_xfers_in == 1);
+    mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, NULL, 0, XFER_RESULT_STALLED);
+    assert(links[VENDORH_LINK_DEGRADED] == 1);
+
+    tuh_sbc_task(100);
+    tuh_sbc_task(105);
+    assert(mock_ctrl_count == 0);
+    tuh_sbc_task(108);
+    assert(mock_ctrl_count == 1);
+    assert(mock_ctrl_req.bRequest == TUSB_REQ_CLEAR_FEATURE && mock_ctrl_req.wIndex == MOCK_EP_IN);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(mock_clear_stall_count == 1 && mock_clear_stall_ep == MOCK_EP_IN);
+    tuh_sbc_task(109);
+    assert(mock_xfers_in == 2);
+
+    // a second failure in a row doubles the backoff, no halt to clear
+    mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, NULL, 0, XFER_RESULT_TIMEOUT);
+    assert(links[VENDORH_LINK_DEGRADED] == 1);
+    tuh_sbc_task(200);
+    tuh_sbc_task(215);
+    assert(mock_xfers_in == 2);
+    tuh_sbc_task(216);
+    assert(mock_xfers_in == 3 && mock_ctrl_count == 1);
+
+    // a good report brings the link back up
+    uint8_t report[26] = { 0 };
+    report[6] = 0x80;
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+    assert(links[VENDORH_LINK_UP] == 1);
+
+    // a failed LED frame is sent again from the task
+    sbc_leds_t leds = { 0 };
+    leds.Gear5 = 0xF;
+    assert(tuh_sbc_set_leds(1, 0, &leds));
+    assert(mock_xfers_out == 1);
+    mock_complete(sbch_xfer_cb, 1, MOCK_EP_OUT, NULL, 0, XFER_RESULT_FAILED);
+    tuh_sbc_task(300);
+    assert(mock_xfers_out == 2);
+
+    // a clear-halt still pending when the device goes away is not applied
+    // to the next device at the same address
+    assert(tuh_sbc_receive_report(1, 0));
+    mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, NULL, 0, XFER_RESULT_STALLED);
+    tuh_sbc_task(400);
+    tuh_sbc_task(500);
+    assert(mock_ctrl_count == 2 && mock_ctrl_pending());
+
+    sbch_close(1);
+    assert(mock_mount(sbch_open, sbch_set_config, 1, 0x0A7B, 0xD000));
+    assert(tuh_sbc_receive_report(1, 0));
+    mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, NULL, 0, XFER_RESULT_STALLED);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(mock_clear_stall_count == 1);
+
+    // the new device gets its own
+    tuh_sbc_task(600);
+    tuh_sbc_task(608);
+    assert(mock_ctrl_count == 3 && mock_ctrl_req.bRequest == TUSB_REQ_CLEAR_FEATURE);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(mock_clear_stall_count == 2);
+
+    printf("recovery ok\n");
+    return 0;
+}
@@ -0,0 +1,93 @@
+// Densha rumble effects on the on/off motors, rate limited
+
+#include "mock_usbh.h"
+#include "densha/densha_host.h"
+
+// run the task every tick_ms until end_ms, completing each command
+static int run(uint32_t *now_ms, uint32_t end_ms, uint32_t tick_ms, int *on_ticks)
+{
+    int const start = mock_ctrl_count;
+    int ticks = 0;
+
+    for (; *now_ms < end_ms; *now_ms += tick_ms)
+    {
+        tuh_densha_task(*now_ms);
+        if (mock_ctrl_pending())
+            assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+
+        densha_outputs_t outputs;
+        assert(tuh_densha_get_outputs(1, 0, &outputs));
+        ticks += outputs.power_rumble;
+    }
+
+    if (on_ticks)
+        *on_ticks = ticks;
+    return mock_ctrl_count - start;
+}
+
+int main(void)
+{
+    mock_reset();
+    denshah_init();
+    assert(mock_mount(denshah_open, denshah_set_config, 1, DENSHA_VID_TAITO, DENSHA_PID_PS2TYPE2));
+
+    uint32_t now_ms = 1000;
+    int on_ticks;
+
+    // half intensity: on about half the time, within the transfer budget
+    assert(tuh_densha_rumble_intensity(1, 0, LEFT_RUMBLE, 128));
+    int xfers = run(&now_ms, 11000, CFG_TUH_DENSHA_RUMBLE_TICK_MS, &on_ticks);
+    assert(xfers <= 10 * CFG_TUH_DENSHA_RUMBLE_MAX_XFER_PER_SEC + 2);
+    assert(on_ticks > 200 && on_ticks < 300);
+
+    // off: one transfer to stop the motor, then nothing
+    assert(tuh_densha_rumble_intensity(1, 0, LEFT_RUMBLE, 0));
+    run(&now_ms, 12000, CFG_TUH_DENSHA_RUMBLE_TICK_MS, &on_ticks);
+    assert(on_ticks <= 1);
+    assert(run(&now_ms, 13000, CFG_TUH_DENSHA_RUMBLE_TICK_MS, &on_ticks) == 0 && on_ticks == 0);
+
+    // three full pulses, then off
+    densha_rumble_fx_t const pulse = { .type = DENSHA_RUMBLE_FX_PULSE, .intensity = 255, .on_ms = 100, .off_ms = 100, .count = 3 };
+    assert(tuh_densha_rumble_fx(1, 0, LEFT_RUMBLE, &pulse));
+    xfers = run(&now_ms, 15000, CFG_TUH_DENSHA_RUMBLE_TICK_MS, &on_ticks);
+    assert(xfers == 6);
+
+    // an effect started long after the last tick still plays from its start
+    densha_rumble_fx_t const decay = { .type = DENSHA_RUMBLE_FX_DECAY, .intensity = 255, .decay_ms = 500 };
+    assert(tuh_densha_rumble_fx(1, 0, RIGHT_RUMBLE, &decay));
+    int const count = mock_ctrl_count;
+    now_ms = 60000;
+    tuh_densha_task(now_ms);
+    assert(mock_ctrl_count == count + 1 && mock_ctrl_buf[0] == RIGHT_RUMBLE && mock_ctrl_buf[1] == 1);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+
+    // a stalled main loop slows it down rather than ending it
+    now_ms += 400;
+    tuh_densha_task(now_ms);
+    densha_outputs_t outputs;
+    assert(tuh_densha_get_outputs(1, 0, &outputs) && outputs.brake_rumble);
+    xfers = run(&now_ms, 62000, CFG_TUH_DENSHA_RUMBLE_TICK_MS, NULL);
+    assert(xfers >= 1 && tuh_densha_get_outputs(1, 0, &outputs) && !outputs.brake_rumble);
+
+    // an off command failing after its retries is sent again, the motor does not keep running
+    assert(tuh_densha_rumble_intensity(1, 0, LEFT_RUMBLE, 255));
+    run(&now_ms, 63000, CFG_TUH_DENSHA_RUMBLE_TICK_MS, NULL);
+    assert(tuh_densha_rumble_intensity(1, 0, LEFT_RUMBLE, 0));
+    now_ms += CFG_TUH_DENSHA_RUMBLE_TICK_MS;
+    tuh_densha_task(now_ms);
+    assert(mock_ctrl_buf[0] == LEFT_RUMBLE && mock_ctrl_buf[1] == 0);
+    for (int i = 0; i <= CFG_TUH_VENDORH_CTRL_RETRIES; i++)
+    {
+        assert(mock_ctrl_complete(XFER_RESULT_STALLED));
+    }
+    assert(!mock_ctrl_pending());
+    int const failed_at = mock_ctrl_count;
+    now_ms += CFG_TUH_DENSHA_RUMBLE_TICK_MS;
+    tuh_densha_task(now_ms);
+    assert(mock_ctrl_count == failed_at + 1 && mock_ctrl_buf[0] == LEFT_RUMBLE && mock_ctrl_buf[1] == 0);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(run(&now_ms, 64000, CFG_TUH_DENSHA_RUMBLE_TICK_MS, NULL) == 0);
+
+    printf("rumble ok\n");
+    return 0;
+}
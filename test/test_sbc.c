@@ -0,0 +1,127 @@
+// SBC mount, report decoding and the LED output pipeline
+
+#include "mock_usbh.h"
+#include "sbc/sbc_host.h"
+
+static int reports;
+static int pads;
+
+void tuh_sbc_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len)
+{
+    (void)dev_addr; (void)instance; (void)report; (void)len;
+    reports++;
+}
+
+void tuh_sbc_pad_received_cb(uint8_t dev_addr, uint8_t instance, sbc_gamepad_t const *pad, sbc_gamepad_delta_t const *delta, uint8_t const *report, uint16_t len)
+{
+    (void)dev_addr; (void)instance; (void)pad; (void)delta; (void)report; (void)len;
+    pads++;
+}
+
+static void test_report(void)
+{
+    uint8_t report[26] = { 0 };
+    report[2] = 0x01;  // first button
+    report[6] = 0x80;  // valid report marker
+    report[9] = 0x40;  // aiming x
+    report[24] = 0x05; // tuner dial
+
+    assert(tuh_sbc_receive_report(1, 0));
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+    assert(reports == 1 && pads == 1);
+
+    sbc_gamepad_t pad;
+    assert(tuh_sbc_get_state(1, 0, &pad));
+    assert(pad.bButtons == 1 && pad.bAimingX == 0x40 && pad.bTunerDial == 5);
+
+    // invalid report: raw callback only, pad kept
+    report[6] = 0x00;
+    assert(tuh_sbc_receive_report(1, 0));
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+    assert(reports == 2 && pads == 1);
+    assert(tuh_sbc_get_state(1, 0, &pad) && pad.bAimingX == 0x40);
+
+    // endpoint that is not ours
+    assert(!sbch_xfer_cb(1, 0x83, XFER_RESULT_SUCCESS, 0));
+}
+
+static void test_leds(void)
+{
+    sbc_leds_t leds = { 0 };
+    leds.Gear5 = 0xF;
+    assert(tuh_sbc_set_leds(1, 0, &leds));
+    assert(mock_xfers_out == 1);
+    assert(mock_edpt_buf(1, MOCK_EP_OUT)[20] == 0xF0);
+
+    // merged while the first frame is in flight
+    assert(tuh_sbc_set_led(1, 0, SBC_LED_EMERGENCY_EJECT, 3));
+    assert(tuh_sbc_set_led(1, 0, SBC_LED_COCKPIT_HATCH, 5));
+    assert(mock_xfers_out == 1);
+
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_OUT, NULL, SBC_LEDS_REPORT_SIZE, XFER_RESULT_SUCCESS));
+    assert(mock_xfers_out == 2);
+    assert(mock_edpt_buf(1, MOCK_EP_OUT)[2] == 0x53);
+
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_OUT, NULL, SBC_LEDS_REPORT_SIZE, XFER_RESULT_SUCCESS));
+    assert(mock_xfers_out == 2);
+
+    // same state again: nothing sent
+    assert(tuh_sbc_set_led(1, 0, SBC_LED_COCKPIT_HATCH, 5));
+    assert(mock_xfers_out == 2);
+
+    // back to the completed state while another frame is in flight
+    assert(tuh_sbc_set_led(1, 0, SBC_LED_COCKPIT_HATCH, 0));
+    assert(mock_xfers_out == 3);
+    assert(tuh_sbc_set_led(1, 0, SBC_LED_COCKPIT_HATCH, 5));
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_OUT, NULL, SBC_LEDS_REPORT_SIZE, XFER_RESULT_SUCCESS));
+    assert(mock_xfers_out == 4);
+    assert(mock_edpt_buf(1, MOCK_EP_OUT)[2] == 0x53);
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_OUT, NULL, SBC_LEDS_REPORT_SIZE, XFER_RESULT_SUCCESS));
+
+    // failed frame: state on the device is unknown, sent again from the task
+    assert(tuh_sbc_set_led(1, 0, SBC_LED_IGNITION, 1));
+    assert(mock_xfers_out == 5);
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_OUT, NULL, 0, XFER_RESULT_FAILED) == false);
+    tuh_sbc_task(0);
+    assert(mock_xfers_out == 6);
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_OUT, NULL, SBC_LEDS_REPORT_SIZE, XFER_RESULT_SUCCESS));
+}
+
+static void test_raw(void)
+{
+    uint8_t frame[SBC_LEDS_REPORT_SIZE] = { 0x00, 0x16 };
+    int const xfers = mock_xfers_out;
+
+    // a rejected transfer leaves the endpoint free
+    mock_xfer_reject = true;
+    assert(!tuh_sbc_send_report(1, 0, frame, sizeof(frame)));
+    mock_xfer_reject = false;
+    assert(tuh_sbc_send_report(1, 0, frame, sizeof(frame)));
+    assert(mock_xfers_out == xfers + 1);
+
+    // busy until it completes
+    assert(!tuh_sbc_send_report(1, 0, frame, sizeof(frame)));
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_OUT, NULL, sizeof(frame), XFER_RESULT_SUCCESS));
+
+    // the raw frame may have changed the LEDs: the same state goes out again
+    assert(tuh_sbc_set_led(1, 0, SBC_LED_IGNITION, 1));
+    assert(mock_xfers_out == xfers + 2);
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_OUT, NULL, SBC_LEDS_REPORT_SIZE, XFER_RESULT_SUCCESS));
+}
+
+int main(void)
+{
+    mock_reset();
+    sbch_init();
+    assert(mock_mount(sbch_open, sbch_set_config, 1, 0x0A7B, 0xD000));
+
+    test_report();
+    test_leds();
+    test_raw();
+
+    sbch_close(1);
+    assert(!tuh_sbc_get_state(1, 0, &(sbc_gamepad_t){ 0 }));
+
+    printf("sbc ok\n");
+    return 0;
+}
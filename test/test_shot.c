@@ -0,0 +1,69 @@
+// GunCon2 trigger edge coordinate latching
+
+#include "mock_usbh.h"
+#include "guncon2/guncon2_host.h"
+
+static uint32_t now_us;
+static int shots;
+
+uint32_t tuh_guncon2_time_us_cb(void)
+{
+    return now_us;
+}
+
+void tuh_guncon2_shot_cb(uint8_t dev_addr, uint8_t instance, guncon2_shot_t const *shot)
+{
+    (void)dev_addr; (void)instance; (void)shot;
+    shots++;
+}
+
+static void send(uint16_t x, uint16_t y, bool trigger)
+{
+    // trigger is bit 5 of byte 1, active low
+    uint8_t report[6] = { 0xFF, trigger ? (uint8_t)~0x20 : 0xFF, (uint8_t)(x & 0xFF), (uint8_t)(x >> 8), (uint8_t)(y & 0xFF), (uint8_t)(y >> 8) };
+
+    now_us += 16667;
+    assert(tuh_guncon2_receive_report(1, 0));
+    assert(mock_complete(guncon2h_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+}
+
+int main(void)
+{
+    mock_reset();
+    guncon2h_init();
+    assert(mock_mount(guncon2h_open, guncon2h_set_config, 1, 0x0B9A, 0x016A));
+
+    guncon2_shot_t shot;
+
+    // on screen at the press, held trigger is not a new shot
+    send(300, 100, false);
+    send(310, 110, true);
+    uint32_t const press_us = now_us;
+    send(320, 120, true);
+    assert(tuh_guncon2_shot_pop(1, 0, &shot));
+    assert(shot.x == 310 && shot.y == 110 && shot.flags == 0 && shot.timestamp_us == press_us && shot.seq == 0);
+    assert(!tuh_guncon2_shot_pop(1, 0, &shot));
+
+    // off screen at the press: previous report
+    send(300, 100, false);
+    send(0, 0, true);
+    assert(tuh_guncon2_shot_pop(1, 0, &shot) && shot.x == 300 && shot.flags == GUNCON2_SHOT_PREVIOUS);
+
+    // off screen before and at the press: next on-screen report
+    send(0, 0, false);
+    send(0, 0, true);
+    send(0, 0, true);
+    send(400, 200, true);
+    assert(tuh_guncon2_shot_pop(1, 0, &shot) && shot.x == 400 && shot.flags == GUNCON2_SHOT_LATE);
+
+    // never on screen: missed
+    send(0, 0, false);
+    send(0, 0, true);
+    for (int i = 0; i < CFG_TUH_GUNCON2_SHOT_WAIT; i++)
+        send(0, 0, true);
+    assert(tuh_guncon2_shot_pop(1, 0, &shot) && shot.flags == GUNCON2_SHOT_MISSED && shot.seq == 3);
+    assert(shots == 4);
+
+    printf("shot ok\n");
+    return 0;
+}
@@ -0,0 +1,96 @@
+// Per-instance counters and latency histograms
+
+#include "mock_usbh.h"
+#include "sbc/sbc_host.h"
+#include "densha/densha_host.h"
+
+static uint32_t now_us;
+
+uint32_t tuh_sbc_time_us_cb(void)
+{
+    return now_us;
+}
+
+static void send(uint8_t valid, xfer_result_t result)
+{
+    uint8_t report[26] = { 0 };
+    report[6] = valid ? 0x80 : 0;
+    now_us += 1000;
+    assert(tuh_sbc_receive_report(1, 0));
+    bool const handled = mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), result);
+    assert(handled == (result == XFER_RESULT_SUCCESS));
+}
+
+int main(void)
+{
+    mock_reset();
+    sbch_init();
+    assert(mock_mount(sbch_open, sbch_set_config, 1, 0x0A7B, 0xD000));
+
+    for (int i = 0; i < 5; i++)
+        send(1, XFER_RESULT_SUCCESS);
+    send(0, XFER_RESULT_SUCCESS);
+    send(1, XFER_RESULT_STALLED);
+
+    vendorh_stats_t stats;
+    assert(tuh_sbc_get_stats(1, 0, &stats));
+    assert(stats.reports == 5 && stats.rejected == 1 && stats.errors[XFER_RESULT_STALLED] == 1);
+    // four gaps of 1000 us fall into the 512..1023 bin
+    assert(stats.interarrival_us[9] == 4);
+
+    // two LED updates while the first frame is out
+    sbc_leds_t leds = { 0 };
+    leds.Gear1 = 0xF;
+    assert(tuh_sbc_set_leds(1, 0, &leds));
+    leds.Gear2 = 0xF;
+    assert(tuh_sbc_set_leds(1, 0, &leds));
+    leds.Gear3 = 0xF;
+    assert(tuh_sbc_set_leds(1, 0, &leds));
+    assert(tuh_sbc_get_stats(1, 0, &stats));
+    assert(stats.out_sent == 1 && stats.out_coalesced == 1);
+
+    // single LED changes are merged the same way
+    assert(tuh_sbc_set_led(1, 0, SBC_LED_GEAR_4, 0xF));
+    assert(tuh_sbc_set_led(1, 0, SBC_LED_GEAR_5, 0xF));
+    assert(tuh_sbc_get_stats(1, 0, &stats));
+    assert(stats.out_sent == 1 && stats.out_coalesced == 3);
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_OUT, NULL, 0, XFER_RESULT_SUCCESS));
+    assert(tuh_sbc_get_stats(1, 0, &stats));
+    assert(stats.out_sent == 2 && stats.out_coalesced == 3);
+
+    // the newest frame equals the one on the wire: dropped, counted once
+    assert(tuh_sbc_set_led(1, 0, SBC_LED_GEAR_5, 0xF));
+    assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_OUT, NULL, 0, XFER_RESULT_SUCCESS));
+    assert(tuh_sbc_get_stats(1, 0, &stats));
+    assert(stats.out_sent == 2 && stats.out_coalesced == 4);
+
+    tuh_sbc_reset_stats(1, 0);
+    assert(tuh_sbc_get_stats(1, 0, &stats) && stats.reports == 0 && stats.out_sent == 0);
+
+    // address out of range or nothing mounted there: refused, nothing touched
+    assert(!tuh_sbc_get_stats(0, 0, &stats));
+    assert(!tuh_sbc_get_stats(CFG_TUH_DEVICE_MAX + 1, 0, &stats));
+    assert(!tuh_sbc_get_stats(3, 0, &stats));
+    assert(!tuh_sbc_get_stats(1, CFG_TUH_SBC, &stats));
+    tuh_sbc_reset_stats(0, 0);
+    tuh_sbc_reset_stats(CFG_TUH_DEVICE_MAX + 1, 0);
+    assert(!tuh_sbc_receive_report(3, 0));
+    assert(!tuh_sbc_receive_report(1, CFG_TUH_SBC));
+    assert(!sbch_xfer_cb(CFG_TUH_DEVICE_MAX + 1, MOCK_EP_IN, XFER_RESULT_SUCCESS, 0));
+
+    // densha: a command replacing a pending one, then cancelling it, counts
+    // once per update
+    denshah_init();
+    assert(mock_mount(denshah_open, denshah_set_config, 2, DENSHA_VID_TAITO, DENSHA_PID_PS2TYPE2));
+    assert(tuh_densha_set_lamp(2, 0, true));
+    assert(tuh_densha_set_rumble_power_handle(2, 0, true));
+    assert(tuh_densha_set_rumble_power_handle(2, 0, false));
+    assert(tuh_densha_get_stats(2, 0, &stats) && stats.out_sent == 1 && stats.out_coalesced == 1);
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(mock_ctrl_complete(XFER_RESULT_SUCCESS));
+    assert(tuh_densha_set_rumble_power_handle(2, 0, false));
+    assert(tuh_densha_get_stats(2, 0, &stats) && stats.out_sent == 2 && stats.out_coalesced == 2);
+
+    printf("stats ok\n");
+    return 0;
+}
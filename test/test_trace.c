@@ -0,0 +1,93 @@
+// Transfer trace capture into the ring sink and replay into a driver
+
+#include "mock_usbh.h"
+#include "sbc/sbc_host.h"
+
+static uint32_t now_us;
+static int pads;
+static uint8_t last_aim;
+static uint32_t waited_us;
+
+uint32_t tuh_sbc_time_us_cb(void)
+{
+    return now_us;
+}
+
+void tuh_sbc_pad_received_cb(uint8_t dev_addr, uint8_t instance, sbc_gamepad_t const *pad, sbc_gamepad_delta_t const *delta, uint8_t const *report, uint16_t len)
+{
+    (void)dev_addr; (void)instance; (void)delta; (void)report; (void)len;
+    pads++;
+    last_aim = pad->bAimingX;
+}
+
+static void wait_us(uint32_t us)
+{
+    waited_us += us;
+}
+
+int main(void)
+{
+    static uint8_t ring_buf[256];
+    static uint8_t trace[1024];
+    uint32_t const record_size = sizeof(vendorh_trace_record_t) + 26;
+
+    vendorh_trace_ring_t ring;
+    vendorh_trace_ring_init(&ring, ring_buf, sizeof(ring_buf));
+    vendorh_trace_set_sink(vendorh_trace_ring_sink, &ring);
+
+    mock_reset();
+    sbch_init();
+    assert(mock_mount(sbch_open, sbch_set_config, 1, 0x0A7B, 0xD000));
+
+    // capture, draining as a consumer task would
+    uint32_t size = 0;
+    for (int i = 0; i < 20; i++)
+    {
+        uint8_t report[26] = { 0 };
+        report[6] = 0x80;
+        report[9] = (uint8_t)i;
+
+        now_us += 1000;
+        assert(tuh_sbc_receive_report(1, 0));
+        assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+        size += vendorh_trace_ring_drain(&ring, trace + size, sizeof(trace) - size);
+    }
+    assert(pads == 20 && ring.dropped == 0 && size == 20 * record_size);
+
+    vendorh_trace_record_t record;
+    memcpy(&record, trace + record_size, sizeof(record));
+    assert(record.timestamp_us == 2000 && record.dev_addr == 1 && record.instance == 0);
+    assert(record.ep_addr == MOCK_EP_IN && record.result == XFER_RESULT_SUCCESS && record.len == 26);
+
+    // a full ring drops whole records
+    for (int i = 0; i < 10; i++)
+    {
+        uint8_t report[26] = { 0 };
+        report[6] = 0x80;
+        assert(tuh_sbc_receive_report(1, 0));
+        assert(mock_complete(sbch_xfer_cb, 1, MOCK_EP_IN, report, sizeof(report), XFER_RESULT_SUCCESS));
+    }
+    assert(ring.dropped == 10 - sizeof(ring_buf) / record_size);
+    vendorh_trace_set_sink(NULL, NULL);
+
+    // replay into a fresh mount with the original spacing
+    sbch_close(1);
+    mock_reset();
+    assert(mock_mount(sbch_open, sbch_set_config, 1, 0x0A7B, 0xD000));
+    pads = 0;
+    assert(vendorh_trace_replay(trace, size, tuh_sbc_replay, wait_us) == 20);
+    assert(pads == 20 && last_aim == 19 && waited_us == 19 * 1000);
+
+    // replaying while polling leaves the queued transfer and its buffer alone
+    assert(tuh_sbc_start_polling(1, 0));
+    uint8_t *const inflight = mock_edpt_buf(1, MOCK_EP_IN);
+    memset(inflight, 0xA5, 26);
+    int const xfers = mock_xfers_in;
+    assert(vendorh_trace_replay(trace, record_size, tuh_sbc_replay, NULL) == 1);
+    assert(pads == 21 && last_aim == 0 && mock_xfers_in == xfers && mock_edpt_busy(1, MOCK_EP_IN));
+    for (int i = 0; i < 26; i++)
+        assert(inflight[i] == 0xA5);
+
+    printf("trace ok\n");
+    return 0;
+}
@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""Convert a Linux usbmon capture into a vendorh trace.
+
+The output can be fed to vendorh_trace_replay, e.g. with
+make -C test replay DRIVER=sbc TRACE=out.bin.
+
+Reads classic pcap files with LINKTYPE_USB_LINUX (189, 48 byte header) or
+LINKTYPE_USB_LINUX_MMAPPED (220, 64 byte header). Save pcapng captures as
+pcap first, e.g. editcap -F pcap in.pcapng out.pcap.
+
+Only completion events ('C') of interrupt transfers are converted:
+
+  timestamp_us  ts_sec/ts_usec, relative to the first record, modulo 2^32
+  dev_addr      --dev-addr, the Linux devnum is not the tinyusb address
+  instance      --instance, usbmon knows nothing about driver instances
+  ep_addr       epnum, direction bit included
+  result        status: 0 success, -EPIPE stalled, -ETIMEDOUT timeout,
+                any other error failed. URBs unlinked on close
+                (-ENOENT, -ECONNRESET, -ESHUTDOWN) are dropped.
+  len, data     len_cap bytes of payload
+
+usage: usbmon2trace.py [--bus N] [--devnum N] [--dev-addr A] [--instance I] in.pcap out.bin
+"""
+
+import argparse
+import errno
+import struct
+import sys
+
+LINKTYPE_USB_LINUX = 189
+LINKTYPE_USB_LINUX_MMAPPED = 220
+
+XFER_TYPE_INTERRUPT = 1
+
+XFER_RESULT_SUCCESS = 0
+XFER_RESULT_FAILED = 1
+XFER_RESULT_STALLED = 2
+XFER_RESULT_TIMEOUT = 3
+
+UNLINKED = (-errno.ENOENT, -errno.ECONNRESET, -errno.ESHUTDOWN)
+
+# vendorh_trace_record_t, packed, little endian
+RECORD = struct.Struct("<IBBBBH")
+
+
+def xfer_result(status):
+    if status == 0:
+        return XFER_RESULT_SUCCESS
+    if status == -errno.EPIPE:
+        return XFER_RESULT_STALLED
+    if status == -errno.ETIMEDOUT:
+        return XFER_RESULT_TIMEOUT
+    return XFER_RESULT_FAILED
+
+
+def packets(f):
+    magic = f.read(4)
+    if magic == b"\xd4\xc3\xb2\xa1":
+        endian = "<"
+    elif magic == b"\xa1\xb2\xc3\xd4":
+        endian = ">"
+    else:
+        sys.exit("not a classic pcap file (pcapng must be converted first)")
+
+    _, _, _, _, _, linktype = struct.unpack(endian + "HHiIII", f.read(20))
+    if linktype not in (LINKTYPE_USB_LINUX, LINKTYPE_USB_LINUX_MMAPPED):
+        sys.exit("link type %d is not a usbmon capture" % linktype)
+
+    header_len = 64 if linktype == LINKTYPE_USB_LINUX_MMAPPED else 48
+    pkt_header = struct.Struct(endian + "IIII")
+
+    while True:
+        hdr = f.read(pkt_header.size)
+        if len(hdr) < pkt_header.size:
+            return
+        _, _, incl_len, _ = pkt_header.unpack(hdr)
+        pkt = f.read(incl_len)
+        if len(pkt) < header_len:
+            return
+        # the usbmon header is in the byte order of the capturing host,
+        # which is the one pcap wrote the file in
+        yield struct.unpack_from(endian + "QcBBBHccqiiII", pkt), pkt[header_len:]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert a usbmon pcap into a vendorh trace")
+    parser.add_argument("--bus", type=int, help="only this USB bus")
+    parser.add_argument("--devnum", type=int, help="only this Linux device number")
+    parser.add_argument("--dev-addr", type=int, default=1, help="dev_addr written to the records (default 1)")
+    parser.add_argument("--instance", type=int, default=0, help="instance written to the records (default 0)")
+    parser.add_argument("input")
+    parser.add_argument("output")
+    args = parser.parse_args()
+
+    first_us = None
+    records = 0
+    with open(args.input, "rb") as f, open(args.output, "wb") as out:
+        for hdr, data in packets(f):
+            (_, event, xfer_type, epnum, devnum, busnum, _, _, ts_sec, ts_usec, status, _, len_cap) = hdr
+
+            if event != b"C" or xfer_type != XFER_TYPE_INTERRUPT:
+                continue
+            if args.bus is not None and busnum != args.bus:
+                continue
+            if args.devnum is not None and devnum != args.devnum:
+                continue
+            if status in UNLINKED:
+                continue
+
+            # 64 bit math, only the spacing between records matters
+            ts_us = ts_sec * 1000000 + ts_usec
+            if first_us is None:
+                first_us = ts_us
+
+            data = data[:len_cap]
+            out.write(RECORD.pack((ts_us - first_us) & 0xFFFFFFFF, args.dev_addr, args.instance,
+                                  epnum, xfer_result(status), len(data)))
+            out.write(data)
+            records += 1
+
+    print("%d records" % records)
+
+
+if __name__ == "__main__":
+    main()